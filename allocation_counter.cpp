@@ -0,0 +1,74 @@
+//
+// Name: Aaron Barlow
+// Date: 2/12/2016
+// Description: Count every allocation made with new for the allocation
+// check. Only linked into a build of contact.cpp with -DCHECK_ALLOCATIONS:
+//    g++ -O2 -DCHECK_ALLOCATIONS contact.cpp allocation_counter.cpp
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+//
+// operator new
+// Allocates memory and counts the allocation, so check_allocations
+// can tell when the menus allocate. Every form of new and delete is
+// replaced so they all agree on malloc and free.
+//
+static atomic<size_t> allocation_count( 0 );
+
+void *operator new( size_t size ) {
+  allocation_count.fetch_add( 1, memory_order_relaxed );
+
+  void *pointer = malloc( size == 0 ? 1 : size );
+  if( pointer == NULL ) throw bad_alloc();
+
+  return pointer;
+}
+
+void *operator new[]( size_t size ) {
+  return operator new( size );
+}
+
+void *operator new( size_t size, const nothrow_t & ) noexcept {
+  allocation_count.fetch_add( 1, memory_order_relaxed );
+  return malloc( size == 0 ? 1 : size );
+}
+
+void *operator new[]( size_t size, const nothrow_t &nothrow ) noexcept {
+  return operator new( size, nothrow );
+}
+
+void operator delete( void *pointer ) noexcept {
+  free( pointer );
+}
+
+void operator delete[]( void *pointer ) noexcept {
+  free( pointer );
+}
+
+void operator delete( void *pointer, size_t ) noexcept {
+  free( pointer );
+}
+
+void operator delete[]( void *pointer, size_t ) noexcept {
+  free( pointer );
+}
+
+void operator delete( void *pointer, const nothrow_t & ) noexcept {
+  free( pointer );
+}
+
+void operator delete[]( void *pointer, const nothrow_t & ) noexcept {
+  free( pointer );
+}
+
+//
+// allocations
+// Returns the number of allocations made so far.
+//
+size_t allocations() {
+  return allocation_count.load( memory_order_relaxed );
+}
@@ -13,34 +13,262 @@
 #include <cstring>
 #include <cstdlib>
 #include <iomanip>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <sstream>
+#include <random>
+#include <cmath>
+#include <string_view>
+#include <cerrno>
+#include <csignal>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <unistd.h>
 #include "contact.h"
 using namespace std;
 
 
-int main() {
+int main( int argc, char *argv[] ) {
   // Set default end points of a doubly linked list
   Contact *first = NULL, *last = NULL;
+  ContactIndexes indexes;
+  Options options;
+
+  // Read any command line options
+  parse_options( argc, argv, &options );
+
+  // List contacts in sorted order without loading them all into memory
+  if( options.stream ) {
+    stream_sorted_contacts( options.stream_memory );
+    return 0;
+  }
 
   // Read a file into dynamically linked contact structures
   load_data( &first, &last );
 
+  // Measure a running server with searches for contacts in the file
+  if( options.load_test != NULL ) {
+    run_load_test( options.load_test, first, &options );
+    return 0;
+  }
+
   // Alphabetically sort the contact list
   sort_contacts( &first, &last );
 
+  // Report or merge duplicate contacts
+  if( options.duplicates ) {
+    find_duplicates( &first, &last, options.merge_duplicates );
+  }
+
+  // Keep the list packed in memory and unpack it only as it is used
+  if( options.compact ) {
+    CompactDirectory directory;
+    build_compact_directory( first, &directory );
+    if( options.index_stats ) display_compact_stats( first, &directory );
+
+    delete_contacts( &first, &last );
+    compact_menu( &directory );
+    return 0;
+  }
+
+  // Build the search indexes over the final list
+  build_indexes( first, &indexes, options.filter_rate );
+  if( options.index_stats ) display_index_stats( &indexes );
+
+  // Display the contacts matching a query instead of a menu
+  if( options.query != NULL ) {
+    string error;
+    vector<Contact*> matches = run_query( &indexes, options.query, &error );
+
+    if( !error.empty() ) {
+      cout << error << endl;
+      return 1;
+    }
+
+    display_header( cout );
+    for( size_t i = 0; i < matches.size(); i++ ) {
+      display_row( cout, matches[i]->first_name, matches[i]->last_name, matches[i]->phone_number );
+    }
+    if( matches.empty() ) cout << "No contact was found." << endl;
+
+    return 0;
+  }
+
+  // Answer requests from clients instead of a single user
+  if( options.server != NULL ) {
+    run_server( options.server, first, last, &indexes, options.workers );
+    return 0;
+  }
+
+  // Set aside the buffers used by the menus
+  MenuBuffers buffers;
+  reserve_menu_buffers( &buffers, &indexes );
+
+#ifdef CHECK_ALLOCATIONS
+  // Check that the menus do not allocate instead of showing them
+  if( options.check_allocations ) {
+    check_allocations( &first, &last, &indexes, &buffers, options.page_size );
+    return 0;
+  }
+#endif
+
   // Display the main menu
-  main_menu( &first, &last );
+  main_menu( &first, &last, &indexes, &buffers, options.page_size );
 
   return 0;
 }
 
 
+//
+// parse_options
+// Read command line options into the given options.
+// Exit the program when an option is not recognized.
+//    --stream          List all contacts in sorted order and exit
+//    --memory <KB>     Memory cap for each sorted run when streaming, at least 64
+//    --duplicates      Display groups of duplicate contacts after sorting
+//    --merge-duplicates  Keep only the first contact of each duplicate group
+//    --index-stats     Display the size of the search indexes after loading
+//    --server <address>  Answer requests on a Unix socket path or localhost port
+//    --workers <count>   Number of threads answering server requests
+//    --load-test <address>  Measure a running server, see run_load_test
+//    --clients <count>   Number of connections opened by the load test
+//    --requests <count>  Number of searches sent on each load test connection
+//    --zipf <exponent>   Pick load test names from a Zipf distribution
+//    --page-size <count> Number of contacts on each page of the paged listing
+//    --compact         Keep names front coded and phone numbers packed in memory
+//    --filter-rate <rate>  Rate at which absent names pass the exact search filter
+//    --query <query>   Display the contacts matching a query and exit
+//    --check-allocations  Check that the menus do not allocate and exit,
+//                         only in a build with -DCHECK_ALLOCATIONS
+//
+void parse_options( int argc, char *argv[], Options *options ) {
+  // Set default options
+  options->stream           = false;
+  options->stream_memory    = DEFAULT_STREAM_MEMORY_KB * 1024;
+  options->duplicates       = false;
+  options->merge_duplicates = false;
+  options->index_stats      = false;
+  options->server           = NULL;
+  options->workers          = max( 1u, thread::hardware_concurrency() );
+  options->load_test        = NULL;
+  options->clients          = DEFAULT_LOAD_TEST_CLIENTS;
+  options->requests         = DEFAULT_LOAD_TEST_REQUESTS;
+  options->zipf             = 0;
+  options->page_size        = DEFAULT_PAGE_SIZE;
+  options->compact          = false;
+  options->filter_rate      = DEFAULT_FILTER_RATE;
+  options->query            = NULL;
+  options->check_allocations = false;
+
+  for( int i = 1; i < argc; i++ ) {
+    if( strcmp( argv[i], "--stream" ) == 0 ) {
+      options->stream = true;
+
+    } else if( strcmp( argv[i], "--memory" ) == 0 && i + 1 < argc ) {
+      char *end;
+      const char *value = argv[++i];
+      errno = 0;
+      unsigned long memory_kb = strtoul( value, &end, 10 );
+
+      // strtoul takes a sign and wraps negative numbers, so only digits are
+      // accepted, and the cap must still fit in bytes.  A cap too small would
+      // spill every contact to a run of its own.
+      if( !isdigit( (unsigned char)value[0] ) || *end != '\0' || errno == ERANGE
+          || memory_kb < MIN_STREAM_MEMORY_KB || memory_kb > SIZE_MAX / 1024 ) {
+        cout << "--memory must be a number of kilobytes from " << MIN_STREAM_MEMORY_KB << " to " << SIZE_MAX / 1024 << "." << endl;
+        display_usage( argv[0] );
+        exit(1);
+      }
+      options->stream_memory = memory_kb * 1024;
+
+    } else if( strcmp( argv[i], "--duplicates" ) == 0 ) {
+      options->duplicates = true;
+
+    } else if( strcmp( argv[i], "--merge-duplicates" ) == 0 ) {
+      options->duplicates       = true;
+      options->merge_duplicates = true;
+
+    } else if( strcmp( argv[i], "--index-stats" ) == 0 ) {
+      options->index_stats = true;
+
+    } else if( strcmp( argv[i], "--server" ) == 0 && i + 1 < argc ) {
+      options->server = argv[++i];
+
+    } else if( strcmp( argv[i], "--workers" ) == 0 && i + 1 < argc ) {
+      options->workers = max( 1, atoi( argv[++i] ) );
+
+    } else if( strcmp( argv[i], "--load-test" ) == 0 && i + 1 < argc ) {
+      options->load_test = argv[++i];
+
+    } else if( strcmp( argv[i], "--clients" ) == 0 && i + 1 < argc ) {
+      options->clients = max( 1, atoi( argv[++i] ) );
+
+    } else if( strcmp( argv[i], "--requests" ) == 0 && i + 1 < argc ) {
+      options->requests = max( 1, atoi( argv[++i] ) );
+
+    } else if( strcmp( argv[i], "--zipf" ) == 0 && i + 1 < argc ) {
+      options->zipf = atof( argv[++i] );
+
+    } else if( strcmp( argv[i], "--page-size" ) == 0 && i + 1 < argc ) {
+      options->page_size = max( 1, atoi( argv[++i] ) );
+
+    } else if( strcmp( argv[i], "--compact" ) == 0 ) {
+      options->compact = true;
+
+    } else if( strcmp( argv[i], "--filter-rate" ) == 0 && i + 1 < argc ) {
+      options->filter_rate = atof( argv[++i] );
+      if( options->filter_rate <= 0 || options->filter_rate >= 1 ) options->filter_rate = DEFAULT_FILTER_RATE;
+
+    } else if( strcmp( argv[i], "--query" ) == 0 && i + 1 < argc ) {
+      options->query = argv[++i];
+
+#ifdef CHECK_ALLOCATIONS
+    } else if( strcmp( argv[i], "--check-allocations" ) == 0 ) {
+      options->check_allocations = true;
+#endif
+
+    } else { // Option was not recognized
+      display_usage( argv[0] );
+      exit(1);
+    }
+  }
+
+  // The compact directory only has its own menu
+  if( options->compact && ( options->server != NULL || options->query != NULL || options->check_allocations ) ) {
+    cout << "--compact cannot be used with --server, --query, or --check-allocations." << endl;
+    display_usage( argv[0] );
+    exit(1);
+  }
+}
+
+//
+// display_usage
+// Displays the command line options of the program.
+//
+void display_usage( const char *program ) {
+  cout << "Usage: " << program << " [--stream] [--memory <KB>] [--duplicates | --merge-duplicates] [--index-stats] [--page-size <count>] [--compact] [--filter-rate <rate>]" << endl
+    << "       " << program << " --query <query>" << endl
+    << "       " << program << " --server <address> [--workers <count>]" << endl
+    << "       " << program << " --load-test <address> [--clients <count>] [--requests <count>] [--zipf <exponent>]" << endl;
+}
+
 //
 // main_menu
 // Present a menu with options that
 // correspond to functions. Continue to
 // display menu until user decides to exit.
 //
-void main_menu( Contact **first, Contact **last ) {
+void main_menu( Contact **first, Contact **last, ContactIndexes *indexes, MenuBuffers *buffers, size_t page_size ) {
   bool exit = false;
   char choice;
 
@@ -54,7 +282,10 @@ void main_menu( Contact **first, Contact **last ) {
     << "2.) List all" << endl
     << "3.) Show first contact in list" << endl
     << "4.) Show last contact in list" << endl
-    << "5.) Exit" << endl
+    << "5.) Fuzzy search" << endl
+    << "6.) List page by page" << endl
+    << "7.) Query" << endl
+    << "8.) Exit" << endl
     << "Choice: ";
     cin >> choice;
 
@@ -62,7 +293,7 @@ void main_menu( Contact **first, Contact **last ) {
     switch(choice) {
       case '1': // Search contacts
         cout << endl;
-        search_contacts( *first );
+        search_contacts( *first, indexes, buffers );
         cout << endl;
         break;
 
@@ -74,17 +305,35 @@ void main_menu( Contact **first, Contact **last ) {
 
       case '3': // Show first contact
         cout << endl;
-        display_first_contact( *first );
+        display_first_contact( *first, indexes );
         cout << endl;
         break;
 
       case '4': // Show last contact
         cout << endl;
-        display_last_contact( *last );
+        display_last_contact( *last, indexes );
         cout << endl;
         break;
 
-      case '5': // Exit program
+      case '5': // Search contacts allowing for typos
+        cout << endl;
+        fuzzy_search_contacts( indexes );
+        cout << endl;
+        break;
+
+      case '6': // List contacts a page at a time
+        cout << endl;
+        page_menu( indexes, page_size );
+        cout << endl;
+        break;
+
+      case '7': // Search several fields at once
+        cout << endl;
+        query_contacts( indexes );
+        cout << endl;
+        break;
+
+      case '8': // Exit program
         exit = true;
         break;
 
@@ -96,6 +345,80 @@ void main_menu( Contact **first, Contact **last ) {
   } while(!exit);
 }
 
+//
+// reserve_menu_buffers
+// Sets aside room in the menu buffers for the longest search
+// and for every contact matching a search, and room in each
+// search cache slot for a search of the menus, so that the
+// menus do not allocate after startup.
+//
+void reserve_menu_buffers( MenuBuffers *buffers, ContactIndexes *indexes ) {
+  SearchCache &cache = indexes->search_cache;
+
+  buffers->user_input.reserve( MAX_SEARCH_LENGTH );
+  buffers->name.reserve( MAX_SEARCH_LENGTH );
+  buffers->matches.reserve( indexes->contact_count );
+
+  lock_guard<mutex> guard( cache.lock );
+
+  for( size_t i = 0; i < cache.slots.size(); i++ ) {
+    cache.slots[i].name.reserve( MAX_SEARCH_LENGTH );
+    cache.slots[i].contacts.reserve( MENU_SEARCH_CONTACTS );
+  }
+}
+
+#ifdef CHECK_ALLOCATIONS
+//
+// check_allocations
+// Runs the main menu over a script of searches, traversals, and
+// pages with its output discarded, and counts the allocations made.
+// The script is run once to fill the search cache and then measured.
+// Exits the program with an error when anything was allocated.
+//
+void check_allocations( Contact **first, Contact **last, ContactIndexes *indexes, MenuBuffers *buffers, size_t page_size ) {
+  string last_name = "a", first_name = "a";
+  size_t middle = indexes->contact_count / 2;
+
+  // Search for names from the middle of the list
+  if( indexes->contact_count > 0 ) {
+    Contact *contact = contact_at( indexes, middle );
+    if( !contact->last_name.empty() ) last_name = lower_case( contact->last_name );
+    if( !contact->first_name.empty() ) first_name = lower_case( contact->first_name );
+  }
+
+  // Search, show first and last contacts, jump, page, and exit
+  string script = "1 " + last_name + " 1 " + last_name + " 1 =" + first_name + " 1 =zzzzzzzz ";
+  if( indexes->contact_count > 0 ) {
+    script += "3 2 2 1 3 " + to_string( middle + 1 ) + " 3 0 4 4 1 1 4 6 2 1 3 2 4 ";
+  }
+  script += "9 8 ";
+  size_t steps = count( script.begin(), script.end(), ' ' );
+
+  stringbuf input( script );
+  NullBuffer output;
+  streambuf *user_input = cin.rdbuf( &input ), *user_output = cout.rdbuf( &output );
+
+  main_menu( first, last, indexes, buffers, page_size );
+
+  size_t before = allocations();
+
+  for( int run = 0; run < ALLOCATION_CHECK_RUNS; run++ ) {
+    input.pubseekpos( 0, ios_base::in );
+    main_menu( first, last, indexes, buffers, page_size );
+  }
+
+  size_t allocated = allocations() - before;
+
+  cin.rdbuf( user_input );
+  cout.rdbuf( user_output );
+
+  cout << allocated << " allocations in " << ALLOCATION_CHECK_RUNS << " runs of "
+    << steps << " menu steps" << endl;
+
+  if( allocated > 0 ) exit(1);
+}
+#endif
+
 //
 // load_data
 // Read contact data from contacts.dat file and put it in a
@@ -104,31 +427,30 @@ void main_menu( Contact **first, Contact **last ) {
 //    FirstName
 //    LastNmae
 //    PhoneNumber
+// A reader thread reads the file ahead in blocks while this
+// thread builds contacts from the block read before.
 //
 void load_data( Contact **first, Contact **last ) {
   ifstream input;
-  input.open(FILE_NAME);
-
-  // When file could not be found
-  if( input.fail() ) {
-    cout << "Input file " << FILE_NAME << " does not exist." << endl;
-    exit(1);
+  open_data_file( input );
 
-  // When file is empty
-  } else if( input.peek() == EOF ) {
-    cout << "Input file " << FILE_NAME << " is empty." << endl;
-    exit(1);
-  }
+  // Start reading the file ahead
+  BlockReader reader;
+  reader.input = &input;
+  thread reader_thread( read_blocks, &reader );
 
   // Set previous node to point to first
   Contact *prev_node = *first;
+  bool at_end = false;
 
-  // Read file data into dynamically allocated structures
-  while( !input.eof() ) {
+  // Read file data into dynamically allocated structures.
+  // Words are read the same way input >> word would, so a file
+  // ending in a line break still ends in one empty contact.
+  while( !at_end ) {
     string first_name, last_name, phone_number;
-    input >> first_name;
-    input >> last_name;
-    input >> phone_number;
+    read_word( &reader, &first_name, &at_end );
+    read_word( &reader, &last_name, &at_end );
+    read_word( &reader, &phone_number, &at_end );
 
     // Create new contact and set new previous node to current node for next iteration
     prev_node = new_contact( prev_node, first_name, last_name, phone_number );
@@ -141,11 +463,142 @@ void load_data( Contact **first, Contact **last ) {
   // Set last node to point to the last contact in the list
   *last = prev_node;
 
-  // Close file
+  // Close file once the reader thread is done with it
+  reader_thread.join();
   input.close();
 
 }
 
+//
+// read_blocks
+// Runs on the reader thread of load_data. Fills the reader's
+// buffers in turn, waiting for a buffer to be used before
+// filling it again, until the end of the file.
+//
+void read_blocks( BlockReader *reader ) {
+  for( int i = 0; ; i = 1 - i ) {
+    LoadBuffer &buffer = reader->buffers[i];
+
+    // Wait until the contacts in this buffer have been built
+    {
+      unique_lock<mutex> guard( reader->lock );
+      reader->changed.wait( guard, [&buffer]() { return !buffer.ready; } );
+    }
+
+    buffer.data.resize( LOAD_BLOCK_SIZE );
+    reader->input->read( &buffer.data[0], LOAD_BLOCK_SIZE );
+    buffer.size = reader->input->gcount();
+    buffer.last = !*reader->input;
+
+    {
+      lock_guard<mutex> guard( reader->lock );
+      buffer.ready = true;
+    }
+    reader->changed.notify_all();
+
+    if( buffer.last ) return;
+  }
+}
+
+//
+// read_word
+// Reads the next word of the file the way input >> word does.
+// Sets at_end once the end of the file is reached. After that
+// every word read is empty.
+//
+void read_word( BlockReader *reader, string *word, bool *at_end ) {
+  word->clear();
+  if( *at_end ) return;
+
+  // Skip the spaces and line breaks before the word
+  while( true ) {
+    if( !fill_buffer( reader ) ) {
+      *at_end = true;
+      return;
+    }
+
+    LoadBuffer &buffer = reader->buffers[reader->current];
+    while( reader->position < buffer.size && isspace( (unsigned char) buffer.data[reader->position] ) ) {
+      reader->position++;
+    }
+
+    if( reader->position < buffer.size ) break;
+  }
+
+  // Read until the next space or line break, which may be in the next buffer
+  while( true ) {
+    LoadBuffer &buffer = reader->buffers[reader->current];
+    size_t start = reader->position;
+
+    while( reader->position < buffer.size && !isspace( (unsigned char) buffer.data[reader->position] ) ) {
+      reader->position++;
+    }
+
+    word->append( &buffer.data[start], reader->position - start );
+
+    if( reader->position < buffer.size ) return;
+
+    if( !fill_buffer( reader ) ) {
+      *at_end = true;
+      return;
+    }
+  }
+}
+
+//
+// fill_buffer
+// Makes sure the current buffer has characters left to read.
+// Hands a used buffer back to the reader thread and waits for
+// the other one. Returns false at the end of the file.
+//
+bool fill_buffer( BlockReader *reader ) {
+  while( true ) {
+    LoadBuffer &buffer = reader->buffers[reader->current];
+
+    // Wait for the reader thread to fill the buffer
+    if( !reader->waited ) {
+      unique_lock<mutex> guard( reader->lock );
+      reader->changed.wait( guard, [&buffer]() { return buffer.ready; } );
+      reader->waited = true;
+    }
+
+    if( reader->position < buffer.size ) return true;
+
+    if( buffer.last ) return false;
+
+    // Hand the used buffer back and move to the other one
+    {
+      lock_guard<mutex> guard( reader->lock );
+      buffer.ready = false;
+    }
+    reader->changed.notify_all();
+
+    reader->current  = 1 - reader->current;
+    reader->position = 0;
+    reader->waited   = false;
+  }
+}
+
+//
+// open_data_file
+// Open the contacts.dat file for reading.
+// Exit the program when the file is missing or empty.
+//
+void open_data_file( ifstream &input ) {
+  input.open(FILE_NAME);
+
+  // When file could not be found
+  if( input.fail() ) {
+    cout << "Input file " << FILE_NAME << " does not exist." << endl;
+    exit(1);
+
+  // When file is empty
+  } else if( input.peek() == EOF ) {
+    cout << "Input file " << FILE_NAME << " is empty." << endl;
+    exit(1);
+  }
+}
+
 //
 // new_contact
 // Dynamically allocates memory for Contact and
@@ -159,6 +612,8 @@ Contact *new_contact( Contact *prev_node, string first_name, string last_name, s
   c->last_name    = last_name;
   c->phone_number = phone_number;
   c->prev         = prev_node;
+  c->next         = NULL;
+  c->rank         = 0;
 
   // When contact does not have a previous contact to point to,
   // Set the previous contact's nexts contact to point to current contact
@@ -176,174 +631,1311 @@ Contact *new_contact( Contact *prev_node, string first_name, string last_name, s
 // Precedence over first name.
 //
 void sort_contacts( Contact **first, Contact **last ) {
-  Contact *current_contact;
-  bool still_sorting;
+  vector< pair<string, Contact*> > keyed_contacts;
 
-  do { // Until all names are alphabetically ordered by last name and first name
+  // Return when there is nothing to sort
+  if( *first == NULL ) return;
 
-    // Set or reset the state of sorting
-    still_sorting = false;
-    // Set current contact to first contact in list
-    current_contact = *first;
+  // Lowercase first name and last name of each contact once so they can be compared
+  for( Contact *contact = *first; contact != NULL; contact = get_next( contact ) ) {
+    keyed_contacts.push_back( make_pair( sort_key( contact->first_name, contact->last_name ), contact ) );
+  }
 
-    while( current_contact->next != NULL ) {
+  // Last name takes precedence over first name.
+  // A stable sort keeps contacts with the same names in file order.
+  stable_sort( keyed_contacts.begin(), keyed_contacts.end(),
+    []( const pair<string, Contact*> &a, const pair<string, Contact*> &b ) { return a.first < b.first; } );
 
-      // Lowercase first name and last name of the current contact so they can be compared
-      string first_name = lower_case(current_contact->first_name);
-      string last_name  = lower_case(current_contact->last_name);
+  // Relink the contacts in sorted order
+  for( size_t i = 0; i < keyed_contacts.size(); i++ ) {
+    Contact *contact = keyed_contacts[i].second;
+    contact->prev = ( i > 0 ) ? keyed_contacts[i - 1].second : NULL;
+    contact->next = ( i + 1 < keyed_contacts.size() ) ? keyed_contacts[i + 1].second : NULL;
+  }
 
-      // Lowercase first name and last name of next contact so they can be compared
-      string next_first_name = lower_case(current_contact->next->first_name);
-      string next_last_name  = lower_case(current_contact->next->last_name);
+  *first = keyed_contacts.front().second;
+  *last  = keyed_contacts.back().second;
 
-      // Last name takes precedence over first name
-      // In cases of same last names, look to first name
-      if( last_name == next_last_name && first_name > next_first_name ) {
-        // Sorting must continue because contacts are still being sorted
-        still_sorting = true;
+}
 
-        // Swap first name, last name, and phone number of current contact
-        swap( current_contact->first_name, current_contact->next->first_name );
-        swap( current_contact->last_name, current_contact->next->last_name );
-        swap( current_contact->phone_number, current_contact->next->phone_number );
+//
+// find_duplicates
+// Finds exact and near-duplicate contacts in the sorted list.
+// Exact duplicates have the same names and phone digits and are
+// found among neighbouring contacts. Near duplicates are found by
+// comparing contacts that share a block, in parallel over blocks.
+// Displays each group of duplicates and, when merge is set, keeps
+// only the first contact of every group.
+//
+void find_duplicates( Contact **first, Contact **last, bool merge ) {
+  vector<Contact*> contacts;
+  vector<string> names, last_names, phones;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  // Lowercase names and strip phone numbers down to digits once
+  for( Contact *contact = *first; contact != NULL; contact = get_next( contact ) ) {
+    contacts.push_back( contact );
+    last_names.push_back( lower_case(contact->last_name) );
+    names.push_back( lower_case(contact->first_name) + ' ' + last_names.back() );
+    phones.push_back( phone_digits( contact->phone_number ) );
+  }
 
-      // Swap when current contact last name is closer to beginning of alphebet than next contact
-      } else if( last_name > next_last_name ) {
-        // Sorting must continue because contacts are still being sorted
-        still_sorting = true;
+  // Every contact starts in a group of its own
+  vector<size_t> groups( contacts.size() );
+  for( size_t i = 0; i < groups.size(); i++ ) groups[i] = i;
+
+  // Sorting puts contacts with the same names next to each other
+  size_t exact_pairs = 0;
+  for( size_t i = 0; i < contacts.size(); ) {
+    size_t end = i + 1;
+    while( end < contacts.size() && names[end] == names[i] ) end++;
+
+    for( size_t a = i; a < end; a++ ) {
+      for( size_t b = a + 1; b < end; b++ ) {
+        if( phones[a] == phones[b] ) {
+          exact_pairs++;
+          join_groups( groups, a, b );
+        }
+      }
+    }
 
-        // Swap first name, last name, and phone number of current contact
-        swap( current_contact->first_name, current_contact->next->first_name );
-        swap( current_contact->last_name, current_contact->next->last_name );
-        swap( current_contact->phone_number, current_contact->next->phone_number );
+    i = end;
+  }
 
-      }
+  // Block contacts by the start of their last name, which keeps blocks in list order,
+  // and by phone digits, which catches mistakes at the start of a name
+  vector< vector<size_t> > blocks;
+  unordered_map<string, size_t> phone_blocks;
 
-      // Set the current contact to the next contact
-      current_contact = get_next( current_contact );
+  for( size_t i = 0; i < contacts.size(); ) {
+    string prefix = last_names[i].substr( 0, DUPLICATE_BLOCK_PREFIX );
+    blocks.push_back( vector<size_t>() );
 
+    while( i < contacts.size() && last_names[i].compare( 0, DUPLICATE_BLOCK_PREFIX, prefix ) == 0 ) {
+      blocks.back().push_back( i++ );
     }
+  }
 
-  } while( still_sorting );
+  for( size_t i = 0; i < contacts.size(); i++ ) {
+    if( phones[i].empty() ) continue;
 
-}
+    unordered_map<string, size_t>::iterator block = phone_blocks.find( phones[i] );
+    if( block == phone_blocks.end() ) {
+      block = phone_blocks.insert( make_pair( phones[i], blocks.size() ) ).first;
+      blocks.push_back( vector<size_t>() );
+    }
+    blocks[block->second].push_back( i );
+  }
 
-//
-// search_contacts
-// Allow the user to search for contacts
-// By contact's first or last names and
-// Display all matches.
-//
-void search_contacts( Contact *first ) {
-  bool contact_found = false;
-  string user_input;
+  // Compare contacts within each block on every available thread
+  unsigned thread_count = max( 1u, thread::hardware_concurrency() );
+  vector< vector< pair<size_t, size_t> > > near_pairs( thread_count );
+  vector<thread> threads;
+  atomic<size_t> next_block( 0 );
+
+  for( unsigned t = 0; t < thread_count; t++ ) {
+    threads.push_back( thread( [&, t]() {
+      for( size_t b = next_block++; b < blocks.size(); b = next_block++ ) {
+        const vector<size_t> &block = blocks[b];
+
+        // Large blocks only compare contacts within a window of each other
+        for( size_t i = 0; i < block.size(); i++ ) {
+          for( size_t j = i + 1; j < block.size() && j <= i + DUPLICATE_WINDOW; j++ ) {
+            size_t x = block[i], y = block[j];
+
+            if( edit_distance( phones[x], phones[y], DUPLICATE_PHONE_DISTANCE ) <= DUPLICATE_PHONE_DISTANCE
+              && edit_distance( names[x], names[y], DUPLICATE_NAME_DISTANCE ) <= DUPLICATE_NAME_DISTANCE ) {
+              near_pairs[t].push_back( make_pair( x, y ) );
+            }
+          }
+        }
+      }
+    } ) );
+  }
 
-  // Prompt user for first or last name
-  cout << "Enter first or last name: ";
-  cin >> user_input;
+  for( size_t t = 0; t < threads.size(); t++ ) threads[t].join();
 
-  cout << endl; // Extra endline to maintain a neat layout
+  for( size_t t = 0; t < near_pairs.size(); t++ ) {
+    for( size_t i = 0; i < near_pairs[t].size(); i++ ) {
+      join_groups( groups, near_pairs[t][i].first, near_pairs[t][i].second );
+    }
+  }
 
-  // Lowercase user input
-  user_input = lower_case(user_input);
+  // Collect the members of every group in list order
+  vector< vector<size_t> > duplicates;
+  vector<size_t> group_index( contacts.size(), SIZE_MAX );
 
-  cout << "First Name                    Last Name                     Phone Number" << endl;
-  cout << "------------------------------------------------------------------------" << endl;
+  for( size_t i = 0; i < contacts.size(); i++ ) {
+    size_t root = find_group( groups, i );
 
-  // Set current contact to the first contact in the list
-  Contact *current_contact = first;
+    if( group_index[root] == SIZE_MAX ) {
+      group_index[root] = duplicates.size();
+      duplicates.push_back( vector<size_t>() );
+    }
+    duplicates[group_index[root]].push_back( i );
+  }
 
-  while( current_contact != NULL ) {
+  double elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
 
-    // Lowercase first and last contact name to equally compare against user input
-    string first_name = lower_case(current_contact->first_name);
-    string last_name  = lower_case(current_contact->last_name);
+  // Display every group with more than one contact
+  size_t group_count = 0, removed = 0;
+  for( size_t g = 0; g < duplicates.size(); g++ ) {
+    if( duplicates[g].size() < 2 ) continue;
 
-    // Select all instances of first or last name matching given input
-    // Check if user input matches first name or last name of contact
-    if( first_name.find(user_input) != string::npos || last_name.find(user_input) != string::npos ) {
-      contact_found = true;
+    group_count++;
+    cout << "Duplicate group " << group_count << endl;
+    display_header( cout );
 
-      // Print contact first name, last name, and phone number
-      cout << setw(30) << left << current_contact->first_name;
-      cout << setw(30) << left << current_contact->last_name;
-      cout << setw(30) << left << current_contact->phone_number << endl;
+    for( size_t i = 0; i < duplicates[g].size(); i++ ) {
+      Contact *contact = contacts[duplicates[g][i]];
+      display_row( cout, contact->first_name, contact->last_name, contact->phone_number );
+
+      // Keep the first contact of the group
+      if( merge && i > 0 ) {
+        remove_contact( first, last, contact );
+        removed++;
+      }
     }
 
-    // Find next contact for possible reiteration
-    current_contact = get_next( current_contact );
+    cout << endl;
+  }
+
+  cout << "Checked " << contacts.size() << " contacts in " << elapsed << " seconds: "
+    << exact_pairs << " exact duplicate pairs, " << group_count << " duplicate groups";
+  if( merge ) cout << ", " << removed << " contacts removed";
+  cout << "." << endl << endl;
+
+}
 
+//
+// find_group
+// Returns the contact that represents the group of the given contact.
+//
+size_t find_group( vector<size_t> &groups, size_t i ) {
+  while( groups[i] != i ) {
+    // Point halfway up the chain to keep later lookups short
+    groups[i] = groups[groups[i]];
+    i = groups[i];
   }
 
-  // Inform user if no contact was found
-  if(!contact_found) cout << "No contact was found." << endl;
+  return i;
+}
+
+//
+// join_groups
+// Puts two contacts and every contact already grouped with them in one group.
+// The contact earliest in the list represents the group.
+//
+void join_groups( vector<size_t> &groups, size_t a, size_t b ) {
+  a = find_group( groups, a );
+  b = find_group( groups, b );
 
+  if( a < b ) groups[b] = a;
+  else if( b < a ) groups[a] = b;
 }
 
 //
-// list_all_contacts
-// Displays all the contacts in the list.
+// edit_distance
+// Returns the number of insertions, deletions, substitutions, and
+// swaps of neighbouring characters needed to turn one string into
+// the other. Returns max_distance + 1 as soon as the distance is
+// known to be larger than max_distance.
 //
-void list_all_contacts( Contact *first ) {
-  // Return to menu when no records
-  if( first == NULL ) {
-    cout << "There are no contacts.";
-    return;
+int edit_distance( const string &a, const string &b, int max_distance ) {
+  int a_length = a.size(), b_length = b.size();
+
+  // Strings that differ in length by too much cannot be close enough
+  if( abs( a_length - b_length ) > max_distance ) return max_distance + 1;
+
+  // Keep only three rows of the distance table, which fit on the stack for short strings
+  int small_rows[3][64];
+  vector<int> large_rows;
+  int *older_row = small_rows[0], *prev_row = small_rows[1], *row = small_rows[2];
+
+  if( b_length + 1 > 64 ) {
+    large_rows.resize( 3 * ( b_length + 1 ) );
+    older_row = &large_rows[0];
+    prev_row = &large_rows[b_length + 1];
+    row = &large_rows[2 * ( b_length + 1 )];
   }
 
-  cout << "First Name                    Last Name                     Phone Number" << endl;
-  cout << "------------------------------------------------------------------------" << endl;
+  for( int j = 0; j <= b_length; j++ ) prev_row[j] = j;
 
-  // Set current node to point to first contact in the list
-  Contact *current_contact = first;
+  for( int i = 1; i <= a_length; i++ ) {
+    int row_min;
+    row[0] = row_min = i;
 
-  do { // Print all contacts
+    for( int j = 1; j <= b_length; j++ ) {
+      int cost = ( a[i - 1] == b[j - 1] ) ? 0 : 1;
+      row[j] = min( min( prev_row[j] + 1, row[j - 1] + 1 ), prev_row[j - 1] + cost );
 
-    if( current_contact != NULL ) {
-      // Print contact first name, last name, and phone number
-      cout << setw(30) << left << current_contact->first_name;
-      cout << setw(30) << left << current_contact->last_name;
-      cout << setw(30) << left << current_contact->phone_number << endl;
+      // Swapped neighbouring characters count as one edit
+      if( i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] ) {
+        row[j] = min( row[j], older_row[j - 2] + 1 );
+      }
+
+      row_min = min( row_min, row[j] );
     }
 
-    // Get next contact for possible reiteration
-    current_contact = get_next( current_contact );
+    // Stop once every path is already too long
+    if( row_min > max_distance ) return max_distance + 1;
 
-  } while( current_contact != NULL );
+    // Rotate the rows for the next character
+    int *oldest_row = older_row;
+    older_row = prev_row;
+    prev_row = row;
+    row = oldest_row;
+  }
 
+  return min( prev_row[b_length], max_distance + 1 );
 }
 
 //
-// traverse_menu
-// Presents a menu to the user which allows the
-// User to go to the next or previous contact until
-// The user chooses to return to the main menu.
+// phone_digits
+// Returns only the digits of a phone number so numbers
+// written in different formats can be compared.
 //
-void traverse_menu( Contact *current_contact ) {
-  Contact *prev_contact, *next_contact;
-  bool exit = false;
+string phone_digits( const string &phone_number ) {
+  string digits;
 
-  // Print the first contact given
-  display_contact( current_contact );
+  for( size_t i = 0; i < phone_number.size(); i++ ) {
+    if( isdigit( (unsigned char) phone_number[i] ) ) digits += phone_number[i];
+  }
 
-  do {
-    cout << endl; // Extra endline to maintain a neat layout
+  return digits;
+}
 
-    cout << "1. Previous" << endl;
-    cout << right << "2. Next" << endl;
-    cout << right << "3. Return to main menu" << endl;
-    cout << "Choice: ";
-    char choice;
-    cin >> choice;
+//
+// remove_contact
+// Unlinks a contact from the list and frees it.
+//
+void remove_contact( Contact **first, Contact **last, Contact *contact ) {
+  if( contact->prev != NULL ) contact->prev->next = contact->next;
+  else *first = contact->next;
 
-    cout << endl; // Extra endline to maintain a neat layout
+  if( contact->next != NULL ) contact->next->prev = contact->prev;
+  else *last = contact->prev;
 
-    // Associate choice with an action
-    switch(choice) {
-      case '1': // Get previous contact (if possible)
-        prev_contact = get_prev( current_contact );
+  delete contact;
+}
 
-        if( prev_contact == NULL ) {
+//
+// search_contacts
+// Allow the user to search for contacts
+// By contact's first or last names and
+// Display all matches.
+//
+void search_contacts( Contact *first, ContactIndexes *indexes, MenuBuffers *buffers ) {
+  // Prompt user for first or last name
+  cout << "Enter first or last name (start with = for an exact match): ";
+  cin >> buffers->user_input;
+
+  cout << endl; // Extra endline to maintain a neat layout
+
+  // Lowercase user input in place
+  buffers->name.assign( buffers->user_input );
+  for( size_t i = 0; i < buffers->name.size(); i++ ) {
+    buffers->name[i] = tolower( (unsigned char) buffers->name[i] );
+  }
+
+  vector<Contact*> &matches = buffers->matches;
+  find_matches( first, indexes, buffers->name, &matches, false );
+
+  display_header( cout );
+
+  // Print contact first name, last name, and phone number
+  for( size_t i = 0; i < matches.size(); i++ ) {
+    display_row( cout, matches[i]->first_name, matches[i]->last_name, matches[i]->phone_number );
+  }
+
+  // Inform user if no contact was found
+  if( matches.empty() ) cout << "No contact was found." << endl;
+
+}
+
+//
+// find_contacts
+// Replaces the matches with every contact whose first or last
+// name contains the given lowercased name, in list order.
+//
+void find_contacts( Contact *first, string_view name, vector<Contact*> *matches ) {
+  matches->clear();
+
+  // Set current contact to the first contact in the list
+  Contact *current_contact = first;
+
+  while( current_contact != NULL ) {
+
+    // Select all instances of first or last name matching given input
+    // Check if user input matches first name or last name of contact
+    if( contains_folded( current_contact->first_name, name ) || contains_folded( current_contact->last_name, name ) ) {
+      matches->push_back( current_contact );
+    }
+
+    // Find next contact for possible reiteration
+    current_contact = get_next( current_contact );
+
+  }
+}
+
+//
+// contains_folded
+// Returns true when the text, compared without case,
+// contains the given lowercased name.
+//
+bool contains_folded( string_view text, string_view name ) {
+  if( name.size() > text.size() ) return false;
+
+  for( size_t i = 0; i + name.size() <= text.size(); i++ ) {
+    size_t j = 0;
+    while( j < name.size() && (char) tolower( (unsigned char) text[i + j] ) == name[j] ) j++;
+
+    if( j == name.size() ) return true;
+  }
+
+  return false;
+}
+
+//
+// find_matches
+// Replaces the matches with the contacts matching a lowercased
+// search. A search starting with = only matches whole first or
+// last names. Any other search matches names containing it.
+// Without allocate, the search cache is only used as far as it
+// can be without allocating, see cached_find_contacts.
+//
+void find_matches( Contact *first, ContactIndexes *indexes, string_view name, vector<Contact*> *matches, bool allocate ) {
+  if( !name.empty() && name[0] == '=' ) find_exact_contacts( indexes, name.substr( 1 ), matches );
+  else cached_find_contacts( first, indexes, name, matches, allocate );
+}
+
+//
+// find_exact_contacts
+// Replaces the matches with the contacts whose lowercased first or
+// last name is the given name, in list order. Names that are not in
+// the list are almost always turned away by the name filter without a lookup.
+//
+void find_exact_contacts( ContactIndexes *indexes, string_view name, vector<Contact*> *matches ) {
+  matches->clear();
+
+  if( !filter_may_contain( &indexes->name_filter, name ) ) return;
+
+  // Every indexed name is found under the hash of the whole name
+  uint64_t name_hash = hash<string_view>()( name );
+  vector<NameDelete>::iterator entry = lower_bound( indexes->name_deletes.begin(),
+    indexes->name_deletes.end(), NameDelete{ name_hash, 0 } );
+
+  for( ; entry != indexes->name_deletes.end() && entry->hash == name_hash; entry++ ) {
+    const IndexedName &indexed = indexes->names[entry->name];
+
+    if( indexed.name == name ) {
+      for( size_t i = 0; i < indexed.ranks.size(); i++ ) {
+        matches->push_back( indexes->columns.contacts[indexed.ranks[i]] );
+      }
+      return;
+    }
+  }
+}
+
+//
+// cached_find_contacts
+// Finds the same contacts as find_contacts, answering repeated
+// searches from the search cache. A full cache replaces the first
+// search that has not been used since the clock hand last passed it,
+// and more searches are forgotten the same way until the matches held
+// fit in SEARCH_CACHE_TOTAL_CONTACTS. A search that another worker
+// stored while this one ran is not stored twice. Without allocate,
+// as for the menus, a search is only remembered when it fits in the
+// room set aside by reserve_menu_buffers.
+//
+void cached_find_contacts( Contact *first, ContactIndexes *indexes, string_view name, vector<Contact*> *matches, bool allocate ) {
+  SearchCache &cache = indexes->search_cache;
+  uint64_t name_hash = hash<string_view>()( name );
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  {
+    lock_guard<mutex> guard( cache.lock );
+    CachedSearch *slot = find_cached_search( &cache, name_hash, name );
+
+    if( slot != NULL ) {
+      slot->referenced = true;
+      matches->assign( slot->contacts.begin(), slot->contacts.end() );
+      cache.hits++;
+      cache.hit_seconds += chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+      return;
+    }
+  }
+
+  // Search the list without holding the cache
+  find_contacts( first, name, matches );
+
+  lock_guard<mutex> guard( cache.lock );
+
+  cache.misses++;
+  cache.miss_seconds += chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  // Another worker may have stored the same search meanwhile
+  CachedSearch *stored = find_cached_search( &cache, name_hash, name );
+  if( stored != NULL ) {
+    stored->referenced = true;
+    return;
+  }
+
+  if( !allocate && ( name.size() > MAX_SEARCH_LENGTH || matches->size() > MENU_SEARCH_CONTACTS ) ) return;
+
+  if( matches->size() > SEARCH_CACHE_TOTAL_CONTACTS ) return;
+
+  CachedSearch &slot = *next_cache_victim( &cache );
+  cache.hand = ( cache.hand + 1 ) % cache.slots.size();
+
+  // Forget more searches until the matches fit
+  while( cache.stored + matches->size() > SEARCH_CACHE_TOTAL_CONTACTS ) {
+    next_cache_victim( &cache );
+    cache.hand = ( cache.hand + 1 ) % cache.slots.size();
+  }
+
+  slot.used       = true;
+  slot.referenced = false;
+  slot.hash       = name_hash;
+  slot.name.assign( name );
+  slot.contacts.assign( matches->begin(), matches->end() );
+  cache.stored += slot.contacts.size();
+}
+
+//
+// find_cached_search
+// Returns the slot holding a search for name, or NULL.
+// The cache lock must be held.
+//
+CachedSearch *find_cached_search( SearchCache *cache, uint64_t name_hash, string_view name ) {
+  for( size_t i = 0; i < cache->slots.size(); i++ ) {
+    CachedSearch &slot = cache->slots[i];
+    if( slot.used && slot.hash == name_hash && slot.name == name ) return &slot;
+  }
+
+  return NULL;
+}
+
+//
+// next_cache_victim
+// Moves the clock hand to the first search that has not been used
+// since the hand last passed it, giving recently used searches
+// another pass, and forgets that search. Returns its slot.
+// The cache lock must be held.
+//
+CachedSearch *next_cache_victim( SearchCache *cache ) {
+  while( cache->slots[cache->hand].used && cache->slots[cache->hand].referenced ) {
+    cache->slots[cache->hand].referenced = false;
+    cache->hand = ( cache->hand + 1 ) % cache->slots.size();
+  }
+
+  CachedSearch *slot = &cache->slots[cache->hand];
+  cache->stored -= slot->contacts.size();
+  slot->used = false;
+  slot->contacts.clear();
+
+  // Give back the memory of a large search instead of keeping it set aside
+  if( slot->contacts.capacity() > MENU_SEARCH_CONTACTS ) vector<Contact*>().swap( slot->contacts );
+
+  return slot;
+}
+
+//
+// clear_search_cache
+// Forgets every cached search. Called whenever the list changes.
+//
+void clear_search_cache( SearchCache *cache ) {
+  lock_guard<mutex> guard( cache->lock );
+
+  cache->slots.assign( SEARCH_CACHE_SLOTS, CachedSearch() );
+  cache->hand   = 0;
+  cache->stored = 0;
+}
+
+//
+// display_cache_stats
+// Displays the hit rate, memory use, and average latency of the search cache.
+//
+void display_cache_stats( ostream &out, SearchCache *cache ) {
+  lock_guard<mutex> guard( cache->lock );
+  size_t searches = cache->hits + cache->misses, bytes = cache->slots.capacity() * sizeof(CachedSearch);
+
+  for( size_t i = 0; i < cache->slots.size(); i++ ) {
+    bytes += cache->slots[i].contacts.capacity() * sizeof(Contact*);
+    bytes += string_heap_bytes( cache->slots[i].name );
+  }
+
+  out << "Search cache: " << cache->hits << " hits, " << cache->misses << " misses, "
+    << ( searches > 0 ? 100.0 * cache->hits / searches : 0.0 ) << "% hit rate, " << bytes / 1024 << " KB" << endl
+    << "Average latency: " << ( cache->hits > 0 ? cache->hit_seconds * 1e6 / cache->hits : 0.0 ) << " us per hit, "
+    << ( cache->misses > 0 ? cache->miss_seconds * 1e6 / cache->misses : 0.0 ) << " us per miss" << endl;
+}
+
+//
+// fuzzy_search_contacts
+// Allow the user to search for contacts by first or last
+// name while allowing for typos. Display matches ranked by
+// how few edits separate them from the given name.
+//
+void fuzzy_search_contacts( ContactIndexes *indexes ) {
+  string user_input;
+
+  // Prompt user for first or last name, which may contain stray spaces
+  cout << "Enter first or last name: ";
+  cin >> ws;
+  getline( cin, user_input );
+
+  cout << endl; // Extra endline to maintain a neat layout
+
+  vector<FuzzyMatch> matches = fuzzy_search( indexes, user_input );
+
+  display_header( cout );
+
+  for( size_t i = 0; i < matches.size(); i++ ) {
+    Contact *contact = matches[i].contact;
+    display_row( cout, contact->first_name, contact->last_name, contact->phone_number );
+  }
+
+  // Inform user if no contact was found
+  if( matches.empty() ) cout << "No contact was found." << endl;
+
+}
+
+//
+// fuzzy_search
+// Lowercases a search and drops any spaces, then finds
+// contacts within a number of typos that suits its length.
+//
+vector<FuzzyMatch> fuzzy_search( ContactIndexes *indexes, const string &user_input ) {
+  string name;
+
+  // Lowercase user input and drop any spaces
+  for( size_t i = 0; i < user_input.size(); i++ ) {
+    if( !isspace( (unsigned char) user_input[i] ) ) name += tolower( (unsigned char) user_input[i] );
+  }
+
+  // Short names allow fewer typos so they do not match most of the list
+  int max_distance = FUZZY_MAX_DISTANCE;
+  if( name.size() <= FUZZY_SHORT_NAME ) max_distance = 1;
+  if( name.size() <= 2 ) max_distance = 0;
+
+  return fuzzy_find( indexes, name, max_distance );
+}
+
+//
+// fuzzy_find
+// Finds contacts whose lowercased first or last name is within
+// max_distance edits of the given name. Matches are ranked by
+// distance and then by their order in the list.
+//
+vector<FuzzyMatch> fuzzy_find( ContactIndexes *indexes, const string &name, int max_distance ) {
+  vector<FuzzyMatch> matches;
+  vector<uint64_t> deletes;
+  vector<uint32_t> candidates;
+
+  // Any name within reach shares a deletion of at most
+  // max_distance characters with the search
+  name_deletes( name, max_distance, &deletes );
+
+  for( size_t i = 0; i < deletes.size(); i++ ) {
+    vector<NameDelete>::iterator entry = lower_bound( indexes->name_deletes.begin(),
+      indexes->name_deletes.end(), NameDelete{ deletes[i], 0 } );
+
+    for( ; entry != indexes->name_deletes.end() && entry->hash == deletes[i]; entry++ ) {
+      candidates.push_back( entry->name );
+    }
+  }
+
+  sort( candidates.begin(), candidates.end() );
+  candidates.erase( unique( candidates.begin(), candidates.end() ), candidates.end() );
+
+  // Group the names within reach by their distance
+  vector< vector<uint32_t> > reached( max_distance + 1 );
+
+  for( size_t i = 0; i < candidates.size(); i++ ) {
+    int distance = edit_distance( name, indexes->names[candidates[i]].name, max_distance );
+    if( distance <= max_distance ) reached[distance].push_back( candidates[i] );
+  }
+
+  // Rank the closest names first. The contacts of every name are in list
+  // order, so each distance merges them by rank instead of sorting its
+  // matches, and contacts are only visited once they are matched.
+  vector<uint32_t> ranks, merged;
+  vector<size_t> runs, merged_runs, run_starts;   // Where each run of ranks, and the matches of each distance, start
+
+  for( int distance = 0; distance <= max_distance; distance++ ) {
+    size_t closer = matches.size();   // Matches of smaller distances end here
+    run_starts.push_back( closer );
+
+    // Every name starts as a run of its own
+    ranks.clear();
+    runs.assign( 1, 0 );
+    for( size_t i = 0; i < reached[distance].size(); i++ ) {
+      const vector<uint32_t> &name_ranks = indexes->names[reached[distance][i]].ranks;
+      ranks.insert( ranks.end(), name_ranks.begin(), name_ranks.end() );
+      runs.push_back( ranks.size() );
+    }
+
+    // Merge neighbouring runs until one is left
+    while( runs.size() > 2 ) {
+      merged.resize( ranks.size() );
+      merged_runs.assign( 1, 0 );
+
+      for( size_t i = 0; i + 1 < runs.size(); i += 2 ) {
+        size_t end = ( i + 2 < runs.size() ) ? runs[i + 2] : runs[i + 1];
+        merge( ranks.begin() + runs[i], ranks.begin() + runs[i + 1], ranks.begin() + runs[i + 1], ranks.begin() + end,
+          merged.begin() + runs[i] );
+        merged_runs.push_back( end );
+      }
+
+      ranks.swap( merged );
+      runs.swap( merged_runs );
+    }
+
+    for( size_t i = 0; i < ranks.size(); i++ ) {
+      // A contact whose first and last names both match is kept once, at its best distance
+      if( matches.size() > closer && matches.back().rank == ranks[i] ) continue;
+      if( closer > 0 && matched_closer( matches, run_starts, ranks[i] ) ) continue;
+
+      FuzzyMatch match = { distance, indexes->columns.contacts[ranks[i]], ranks[i] };
+      matches.push_back( match );
+    }
+  }
+
+  return matches;
+}
+
+//
+// matched_closer
+// Returns true when the contact of a rank matched at a smaller distance. The
+// matches of each smaller distance are one run in list order,
+// starting at run_starts and ending where the last run starts.
+//
+bool matched_closer( const vector<FuzzyMatch> &matches, const vector<size_t> &run_starts, size_t rank ) {
+  for( size_t run = 0; run + 1 < run_starts.size(); run++ ) {
+    vector<FuzzyMatch>::const_iterator end = matches.begin() + run_starts[run + 1];
+    vector<FuzzyMatch>::const_iterator found = lower_bound( matches.begin() + run_starts[run], end, rank,
+      []( const FuzzyMatch &match, size_t rank ) { return match.rank < rank; } );
+
+    if( found != end && found->rank == rank ) return true;
+  }
+
+  return false;
+}
+
+//
+// name_deletes
+// Adds the hash of every string made by deleting up to
+// max_deletes characters from the name, including the name itself.
+// Each hash is added once.
+//
+void name_deletes( const string &name, int max_deletes, vector<uint64_t> *deletes ) {
+  vector<string> current( 1, name ), next;
+  size_t start = deletes->size();
+
+  deletes->push_back( hash<string>()( name ) );
+
+  // Delete one more character from every string of the previous round
+  for( int round = 0; round < max_deletes; round++ ) {
+    next.clear();
+
+    for( size_t i = 0; i < current.size(); i++ ) {
+      for( size_t j = 0; j < current[i].size(); j++ ) {
+        // Deleting either of two equal neighbours gives the same string
+        if( j > 0 && current[i][j] == current[i][j - 1] ) continue;
+
+        string deleted = current[i];
+        deleted.erase( j, 1 );
+        deletes->push_back( hash<string>()( deleted ) );
+        next.push_back( deleted );
+      }
+    }
+
+    current.swap( next );
+  }
+
+  sort( deletes->begin() + start, deletes->end() );
+  deletes->erase( unique( deletes->begin() + start, deletes->end() ), deletes->end() );
+}
+
+//
+// query_contacts
+// Allow the user to search with a query over several fields
+// and display all matching contacts.
+//
+void query_contacts( ContactIndexes *indexes ) {
+  string user_input, error;
+
+  // Prompt user for a query, which contains spaces
+  cout << "Fields are first:, last:, and phone:. End a value with * to match its start." << endl
+    << "Combine fields with AND, OR, NOT, and parentheses." << endl
+    << "Enter query: ";
+  cin >> ws;
+  getline( cin, user_input );
+
+  cout << endl; // Extra endline to maintain a neat layout
+
+  vector<Contact*> matches = run_query( indexes, user_input, &error );
+
+  // Inform user when the query could not be read
+  if( !error.empty() ) {
+    cout << error << endl;
+    return;
+  }
+
+  display_header( cout );
+
+  // Print contact first name, last name, and phone number
+  for( size_t i = 0; i < matches.size(); i++ ) {
+    display_row( cout, matches[i]->first_name, matches[i]->last_name, matches[i]->phone_number );
+  }
+
+  // Inform user if no contact was found
+  if( matches.empty() ) cout << "No contact was found." << endl;
+
+}
+
+//
+// run_query
+// Returns the contacts matching a query, in list order.
+// Queries are made of field:value terms, for example
+//    last:Bar* AND phone:865*
+//    first:Similar* NOT last:SimilarLastB
+// A value ending in * matches the start of the field. Terms next to
+// each other must both match, and "a NOT b" means a AND NOT b.
+// Sets error when the query cannot be read.
+//
+vector<Contact*> run_query( ContactIndexes *indexes, const string &query, string *error ) {
+  QueryParser parser;
+  parser.indexes  = indexes;
+  parser.position = 0;
+  parser.depth    = 0;
+
+  // Split the query into words and parentheses
+  for( size_t i = 0; i < query.size(); ) {
+    if( isspace( (unsigned char) query[i] ) ) {
+      i++;
+    } else if( query[i] == '(' || query[i] == ')' ) {
+      parser.tokens.push_back( string( 1, query[i++] ) );
+    } else {
+      size_t start = i;
+      while( i < query.size() && !isspace( (unsigned char) query[i] ) && query[i] != '(' && query[i] != ')' ) i++;
+      parser.tokens.push_back( query.substr( start, i - start ) );
+    }
+  }
+
+  vector<Contact*> matches;
+  Bitmap result = parse_or( &parser );
+
+  if( parser.error.empty() && parser.position < parser.tokens.size() ) {
+    parser.error = "Unexpected \"" + parser.tokens[parser.position] + "\" in query.";
+  }
+
+  if( parser.tokens.empty() ) parser.error = "The query is empty.";
+
+  if( !parser.error.empty() ) {
+    *error = parser.error;
+    return matches;
+  }
+
+  // Collect the contact of every set bit
+  for( size_t word = 0; word < result.size(); word++ ) {
+    for( uint64_t bits = result[word]; bits != 0; bits &= bits - 1 ) {
+      matches.push_back( indexes->columns.contacts[word * 64 + __builtin_ctzll( bits )] );
+    }
+  }
+
+  return matches;
+}
+
+//
+// parse_or
+// Reads terms joined by OR and returns their combined matches.
+//
+Bitmap parse_or( QueryParser *parser ) {
+  Bitmap result = parse_and( parser );
+
+  while( parser->error.empty() && parser->position < parser->tokens.size()
+    && parser->tokens[parser->position] == "OR" ) {
+    parser->position++;
+    Bitmap other = parse_and( parser );
+
+    for( size_t i = 0; i < result.size(); i++ ) result[i] |= other[i];
+  }
+
+  return result;
+}
+
+//
+// parse_and
+// Reads terms joined by AND, NOT, or nothing at all
+// and returns the matches they have in common.
+//
+Bitmap parse_and( QueryParser *parser ) {
+  Bitmap result = parse_term( parser );
+
+  while( parser->error.empty() && parser->position < parser->tokens.size() ) {
+    const string &token = parser->tokens[parser->position];
+    bool negate = false;
+
+    if( token == "OR" || token == ")" ) break;
+
+    if( token == "AND" ) {
+      parser->position++;
+    } else if( token == "NOT" ) { // "a NOT b" leaves out the matches of b
+      parser->position++;
+      negate = true;
+    }
+
+    Bitmap other = parse_term( parser );
+
+    if( negate ) {
+      for( size_t i = 0; i < result.size(); i++ ) result[i] &= ~other[i];
+    } else {
+      for( size_t i = 0; i < result.size(); i++ ) result[i] &= other[i];
+    }
+  }
+
+  return result;
+}
+
+//
+// parse_term
+// Reads a field:value term, a NOT term, or a query in
+// parentheses and returns its matches. Nesting deeper than
+// QUERY_MAX_DEPTH is an error rather than a stack overflow.
+//
+Bitmap parse_term( QueryParser *parser ) {
+  size_t count = parser->indexes->contact_count;
+  Bitmap result( ( count + 63 ) / 64, 0 );
+
+  if( parser->position >= parser->tokens.size() ) {
+    parser->error = "The query ends too soon.";
+    return result;
+  }
+
+  string token = parser->tokens[parser->position++];
+
+  if( ( token == "(" || token == "NOT" ) && parser->depth >= QUERY_MAX_DEPTH ) {
+    parser->error = "The query is nested too deeply.";
+    return result;
+  }
+
+  if( token == "(" ) {
+    parser->depth++;
+    result = parse_or( parser );
+    parser->depth--;
+
+    if( parser->error.empty() && ( parser->position >= parser->tokens.size() || parser->tokens[parser->position] != ")" ) ) {
+      parser->error = "A parenthesis is not closed.";
+    }
+    parser->position++;
+    return result;
+  }
+
+  if( token == "NOT" ) {
+    parser->depth++;
+    result = parse_term( parser );
+    parser->depth--;
+
+    // Leave out the matches, keeping bits past the last contact clear
+    for( size_t i = 0; i < result.size(); i++ ) result[i] = ~result[i];
+    if( count % 64 != 0 ) result.back() &= ( (uint64_t) 1 << ( count % 64 ) ) - 1;
+    return result;
+  }
+
+  size_t colon = token.find( ':' );
+  if( colon == string::npos ) {
+    parser->error = "\"" + token + "\" is not a field:value term.";
+    return result;
+  }
+
+  string field = lower_case(token.substr( 0, colon ));
+  string value = lower_case(token.substr( colon + 1 ));
+  bool prefix  = !value.empty() && value[value.size() - 1] == '*';
+  if( prefix ) value.erase( value.size() - 1 );
+
+  if( field == "first" ) {
+    match_column( parser->indexes, &parser->indexes->columns.first_names, value, prefix, &result );
+  } else if( field == "last" ) {
+    match_last_names( parser->indexes, value, prefix, &result );
+  } else if( field == "phone" ) {
+    match_column( parser->indexes, &parser->indexes->columns.phone_numbers, value, prefix, &result );
+  } else {
+    parser->error = "\"" + field + "\" is not a field. Use first, last, or phone.";
+  }
+
+  return result;
+}
+
+//
+// match_column
+// Sets the bit of every contact whose value in a column is, or
+// starts with, the given value. Whole first names are looked up
+// in the name index, and those not in the list are turned away
+// by the name filter without a lookup.
+//
+void match_column( ContactIndexes *indexes, StringColumn *column, const string &value, bool prefix, Bitmap *result ) {
+  if( !prefix && column == &indexes->columns.first_names ) {
+    vector<Contact*> matches;
+    find_exact_contacts( indexes, value, &matches );
+
+    // The name index also holds last names, so check which field matched
+    for( size_t i = 0; i < matches.size(); i++ ) {
+      size_t rank = matches[i]->rank;
+      if( column_value( column, rank ) == value ) (*result)[rank / 64] |= (uint64_t) 1 << ( rank % 64 );
+    }
+    return;
+  }
+
+  const char *chars = column->chars.data();
+  const size_t *offsets = column->offsets.data();
+  size_t count = column->offsets.size() - 1;
+
+  for( size_t i = 0; i < count; i++ ) {
+    size_t length = offsets[i + 1] - offsets[i];
+
+    // Checking the first character before the rest skips most values quickly
+    if( ( prefix ? length >= value.size() : length == value.size() )
+      && ( value.empty() || chars[offsets[i]] == value[0] )
+      && memcmp( chars + offsets[i], value.data(), value.size() ) == 0 ) {
+      (*result)[i / 64] |= (uint64_t) 1 << ( i % 64 );
+    }
+  }
+}
+
+//
+// match_last_names
+// Sets the bit of every contact whose last name is, or starts with,
+// the given value. The list is sorted by lowercased last name, so
+// the matches are one run of positions found by binary search.
+//
+void match_last_names( ContactIndexes *indexes, const string &value, bool prefix, Bitmap *result ) {
+  StringColumn &column = indexes->columns.last_names;
+  size_t count = column.offsets.size() - 1;
+
+  if( !prefix && !filter_may_contain( &indexes->name_filter, value ) ) return;
+
+  // Find the first last name that is not before the value
+  size_t low = 0, high = count;
+  while( low < high ) {
+    size_t middle = ( low + high ) / 2;
+    if( column_value( &column, middle ) < value ) low = middle + 1;
+    else high = middle;
+  }
+
+  // Set the bits of the run of matching last names
+  for( size_t i = low; i < count; i++ ) {
+    string_view name = column_value( &column, i );
+
+    if( prefix ? name.compare( 0, value.size(), value ) != 0 : name != value ) break;
+    (*result)[i / 64] |= (uint64_t) 1 << ( i % 64 );
+  }
+}
+
+//
+// column_value
+// Returns the value of a column at a position in the list.
+//
+string_view column_value( StringColumn *column, size_t position ) {
+  return string_view( column->chars.data() + column->offsets[position],
+    column->offsets[position + 1] - column->offsets[position] );
+}
+
+//
+// add_to_column
+// Appends a lowercased value to a column.
+//
+void add_to_column( StringColumn *column, const string &value ) {
+  for( size_t i = 0; i < value.size(); i++ ) column->chars.push_back( tolower( (unsigned char) value[i] ) );
+  column->offsets.push_back( column->chars.size() );
+}
+
+//
+// list_all_contacts
+// Displays all the contacts in the list.
+//
+void list_all_contacts( Contact *first ) {
+  // Return to menu when no records
+  if( first == NULL ) {
+    cout << "There are no contacts.";
+    return;
+  }
+
+  display_header( cout );
+
+  // Set current node to point to first contact in the list
+  Contact *current_contact = first;
+
+  do { // Print all contacts
+
+    if( current_contact != NULL ) {
+      // Print contact first name, last name, and phone number
+      display_row( cout, current_contact->first_name, current_contact->last_name, current_contact->phone_number );
+    }
+
+    // Get next contact for possible reiteration
+    current_contact = get_next( current_contact );
+
+  } while( current_contact != NULL );
+
+}
+
+//
+// stream_sorted_contacts
+// Displays all contacts in sorted order without loading the
+// whole list. Contacts are read into sorted runs of at most
+// memory_cap bytes, which are spilled to temporary files and
+// merged straight into the listing.
+//
+void stream_sorted_contacts( size_t memory_cap ) {
+  ifstream input;
+  open_data_file( input );
+
+  vector<ContactRecord> records;
+  vector<FILE*> runs;
+  vector<int> run_levels;
+  size_t used_memory = 0;
+
+  // Read file data into sorted runs the same way load_data reads it
+  while( !input.eof() ) {
+    ContactRecord record;
+    input >> record.first_name;
+    input >> record.last_name;
+    input >> record.phone_number;
+    record.sort_key = sort_key( record.first_name, record.last_name );
+
+    used_memory += record.first_name.capacity() + record.last_name.capacity()
+      + record.phone_number.capacity() + record.sort_key.capacity() + sizeof(ContactRecord);
+    records.push_back( move(record) );
+
+    // Spill the run to a temporary file once it reaches the memory cap
+    if( used_memory >= memory_cap ) {
+      runs.push_back( write_run( records ) );
+      run_levels.push_back( 0 );
+      used_memory = 0;
+
+      // Merge the newest runs whenever enough of them share a level,
+      // which keeps the number of open temporary files bounded
+      while( runs.size() >= MAX_MERGE_RUNS
+        && run_levels[runs.size() - MAX_MERGE_RUNS] == run_levels.back() ) {
+        vector<FILE*> group( runs.end() - MAX_MERGE_RUNS, runs.end() );
+        int level = run_levels.back() + 1;
+
+        runs.resize( runs.size() - MAX_MERGE_RUNS );
+        run_levels.resize( run_levels.size() - MAX_MERGE_RUNS );
+        runs.push_back( merge_into_run( group ) );
+        run_levels.push_back( level );
+      }
+    }
+  }
+
+  // Close file
+  input.close();
+
+  // When every contact fit in memory there is nothing to merge
+  if( runs.empty() ) {
+    stable_sort( records.begin(), records.end(),
+      []( const ContactRecord &a, const ContactRecord &b ) { return a.sort_key < b.sort_key; } );
+
+    display_header( cout );
+    for( size_t i = 0; i < records.size(); i++ ) {
+      display_row( cout, records[i].first_name, records[i].last_name, records[i].phone_number );
+    }
+    return;
+  }
+
+  // Spill the remaining contacts and release the run buffer
+  if( !records.empty() ) runs.push_back( write_run( records ) );
+  vector<ContactRecord>().swap( records );
+
+  // Merge groups of runs until few enough remain to merge at once
+  while( runs.size() > MAX_MERGE_RUNS ) {
+    vector<FILE*> merged_runs;
+
+    for( size_t i = 0; i < runs.size(); i += MAX_MERGE_RUNS ) {
+      vector<FILE*> group( runs.begin() + i, runs.begin() + min( runs.size(), i + MAX_MERGE_RUNS ) );
+      merged_runs.push_back( merge_into_run( group ) );
+    }
+
+    runs = merged_runs;
+  }
+
+  // Merge the final runs into the listing
+  display_header( cout );
+  merge_runs( runs, NULL );
+
+}
+
+//
+// sort_key
+// Returns a key that orders contacts the same way sort_contacts does.
+// Last name takes precedence over first name.
+//
+string sort_key( const string &first_name, const string &last_name ) {
+  return lower_case(last_name) + '\0' + lower_case(first_name);
+}
+
+//
+// new_run
+// Creates a temporary run file, which is removed once closed.
+//
+FILE *new_run() {
+  FILE *run = tmpfile();
+
+  if( run == NULL ) {
+    cout << "Could not create a temporary file." << endl;
+    exit(1);
+  }
+
+  return run;
+}
+
+//
+// merge_into_run
+// Merges sorted runs into a new run and returns it ready for reading.
+//
+FILE *merge_into_run( vector<FILE*> &runs ) {
+  FILE *merged = new_run();
+
+  merge_runs( runs, merged );
+  rewind( merged );
+
+  return merged;
+}
+
+//
+// write_run
+// Sorts the given records and writes them to a temporary file.
+// The records are cleared and the file is returned ready for reading.
+//
+FILE *write_run( vector<ContactRecord> &records ) {
+  FILE *run = new_run();
+
+  // A stable sort keeps contacts with equal names in file order
+  stable_sort( records.begin(), records.end(),
+    []( const ContactRecord &a, const ContactRecord &b ) { return a.sort_key < b.sort_key; } );
+
+  for( size_t i = 0; i < records.size(); i++ ) {
+    write_run_record( run, records[i] );
+  }
+
+  records.clear();
+  rewind( run );
+
+  return run;
+}
+
+//
+// write_run_record
+// Writes the first name, last name, and phone number of
+// a record to a run file, each prefixed by its length.
+//
+void write_run_record( FILE *run, const ContactRecord &record ) {
+  const string *fields[] = { &record.first_name, &record.last_name, &record.phone_number };
+
+  for( int i = 0; i < 3; i++ ) {
+    size_t length = fields[i]->size();
+    fwrite( &length, sizeof(length), 1, run );
+    fwrite( fields[i]->data(), 1, length, run );
+  }
+}
+
+//
+// read_run_record
+// Reads the next record from a run file.
+// Returns false when the run has no more records.
+//
+bool read_run_record( FILE *run, ContactRecord *record ) {
+  string *fields[] = { &record->first_name, &record->last_name, &record->phone_number };
+
+  for( int i = 0; i < 3; i++ ) {
+    size_t length;
+    if( fread( &length, sizeof(length), 1, run ) != 1 ) return false;
+
+    fields[i]->resize( length );
+    if( length > 0 && fread( &(*fields[i])[0], 1, length, run ) != length ) return false;
+  }
+
+  record->sort_key = sort_key( record->first_name, record->last_name );
+
+  return true;
+}
+
+//
+// merge_runs
+// Merges sorted runs into the output run file, or displays
+// the merged contacts when no output file is given.
+// The merged runs are closed, which removes them.
+//
+void merge_runs( vector<FILE*> &runs, FILE *output ) {
+  vector<ContactRecord> heads( runs.size() );
+
+  // Earlier runs win ties so contacts with equal names stay in file order
+  auto comes_after = [&heads]( size_t a, size_t b ) {
+    int order = heads[a].sort_key.compare( heads[b].sort_key );
+    return order > 0 || ( order == 0 && a > b );
+  };
+  priority_queue<size_t, vector<size_t>, decltype(comes_after)> queue( comes_after );
+
+  // Read the first record of every run
+  for( size_t i = 0; i < runs.size(); i++ ) {
+    if( read_run_record( runs[i], &heads[i] ) ) queue.push( i );
+  }
+
+  while( !queue.empty() ) {
+    size_t i = queue.top();
+    queue.pop();
+
+    if( output != NULL ) {
+      write_run_record( output, heads[i] );
+    } else {
+      display_row( cout, heads[i].first_name, heads[i].last_name, heads[i].phone_number );
+    }
+
+    // Replace the record with the next one from the same run
+    if( read_run_record( runs[i], &heads[i] ) ) queue.push( i );
+  }
+
+  // Close and remove the merged runs
+  for( size_t i = 0; i < runs.size(); i++ ) {
+    fclose( runs[i] );
+  }
+}
+
+//
+// traverse_menu
+// Presents a menu to the user which allows the
+// User to go to the next or previous contact until
+// The user chooses to return to the main menu.
+//
+void traverse_menu( Contact *current_contact, ContactIndexes *indexes ) {
+  Contact *prev_contact, *next_contact;
+  size_t position;
+  bool exit = false;
+
+  // Print the first contact given
+  display_contact( current_contact );
+
+  do {
+    cout << endl; // Extra endline to maintain a neat layout
+
+    cout << "1. Previous" << endl;
+    cout << right << "2. Next" << endl;
+    cout << right << "3. Jump to position" << endl;
+    cout << right << "4. Return to main menu" << endl;
+    cout << "Choice: ";
+    char choice;
+    cin >> choice;
+
+    cout << endl; // Extra endline to maintain a neat layout
+
+    // Associate choice with an action
+    switch(choice) {
+      case '1': // Get previous contact (if possible)
+        prev_contact = get_prev( current_contact );
+
+        if( prev_contact == NULL ) {
           cout << "No contact was found." << endl;
         } else { // Contact was found
           // Set contact to point to previous contact for possible reiteration
@@ -353,17 +1945,1320 @@ void traverse_menu( Contact *current_contact ) {
         }
         break;
 
-      case '2': // Get next contact (if possible)
-        next_contact = get_next( current_contact );
+      case '2': // Get next contact (if possible)
+        next_contact = get_next( current_contact );
+
+        if( next_contact == NULL ) {
+          cout << "No contact was found." << endl;
+        } else { // Contact was found
+          // Set contact to point to next contact for possible reiteration
+          current_contact = next_contact;
+          // Print contact first name, last name, and phone number
+          display_contact( current_contact );
+        }
+        break;
+
+      case '3': // Go straight to a position in the list
+        cout << "Enter position (1-" << indexes->contact_count << "): ";
+        position = read_number();
+        cout << endl;
+
+        if( position < 1 || position > indexes->contact_count ) {
+          cout << "No contact was found." << endl;
+        } else { // Contact was found
+          current_contact = contact_at( indexes, position - 1 );
+          // Print contact first name, last name, and phone number
+          display_contact( current_contact );
+        }
+        break;
+
+      case '4': //Exit traverse menu
+        exit = true;
+        break;
+
+      default: // If invalid input was entered
+        cout << "Please enter a valid option." << endl;
+        break;
+    }
+
+  } while(!exit);
+
+}
+
+//
+// page_menu
+// Presents the list one page at a time and allows the
+// User to go to the next, previous, or any page until
+// The user chooses to return to the main menu.
+//
+void page_menu( ContactIndexes *indexes, size_t page_size ) {
+  size_t page = 1, page_count = ( indexes->contact_count + page_size - 1 ) / page_size;
+  bool exit = false;
+
+  // Return to menu when no records
+  if( page_count == 0 ) {
+    cout << "There are no contacts.";
+    return;
+  }
+
+  // Print the first page
+  display_page( indexes, page, page_size );
+
+  do {
+    cout << endl; // Extra endline to maintain a neat layout
+
+    cout << "1. Previous page" << endl;
+    cout << "2. Next page" << endl;
+    cout << "3. Go to page" << endl;
+    cout << "4. Return to main menu" << endl;
+    cout << "Choice: ";
+    char choice;
+    cin >> choice;
+
+    cout << endl; // Extra endline to maintain a neat layout
+
+    // Associate choice with an action
+    switch(choice) {
+      case '1': // Get previous page (if possible)
+        if( page == 1 ) {
+          cout << "No page was found." << endl;
+        } else {
+          display_page( indexes, --page, page_size );
+        }
+        break;
+
+      case '2': // Get next page (if possible)
+        if( page == page_count ) {
+          cout << "No page was found." << endl;
+        } else {
+          display_page( indexes, ++page, page_size );
+        }
+        break;
+
+      case '3': // Go straight to a page
+        {
+          cout << "Enter page (1-" << page_count << "): ";
+          size_t new_page = read_number();
+          cout << endl;
+
+          if( new_page < 1 || new_page > page_count ) {
+            cout << "No page was found." << endl;
+          } else {
+            page = new_page;
+            display_page( indexes, page, page_size );
+          }
+        }
+        break;
+
+      case '4': // Exit page menu
+        exit = true;
+        break;
+
+      default: // If invalid input was entered
+        cout << "Please enter a valid option." << endl;
+        break;
+    }
+
+  } while(!exit);
+
+}
+
+//
+// display_page
+// Displays one page of contacts, counting pages from one.
+//
+void display_page( ContactIndexes *indexes, size_t page, size_t page_size ) {
+  size_t page_count = ( indexes->contact_count + page_size - 1 ) / page_size;
+  Contact *contact = contact_at( indexes, ( page - 1 ) * page_size );
+
+  display_header( cout );
+
+  // Print contact first name, last name, and phone number
+  for( size_t i = 0; i < page_size && contact != NULL; i++ ) {
+    display_row( cout, contact->first_name, contact->last_name, contact->phone_number );
+    contact = get_next( contact );
+  }
+
+  cout << endl << "Page " << page << " of " << page_count << endl;
+}
+
+//
+// read_number
+// Reads a whole number from the user.
+// Returns zero when something else was entered.
+//
+size_t read_number() {
+  size_t number = 0;
+  bool valid = true;
+
+  // Read one word a character at a time, like cin >> would
+  cin >> ws;
+  for( int c = cin.peek(); c != EOF && !isspace( c ); c = cin.peek() ) {
+    cin.get();
+
+    if( c < '0' || c > '9' ) valid = false;
+    else if( number > ( SIZE_MAX - ( c - '0' ) ) / 10 ) number = SIZE_MAX;
+    else number = number * 10 + ( c - '0' );
+  }
+
+  return valid ? number : 0;
+}
+
+//
+// display_contact
+// Displays a given contact from the list.
+//
+void display_contact( Contact *contact ) {
+  display_header( cout );
+
+  // Print first name, last name, and phone number
+  display_row( cout, contact->first_name, contact->last_name, contact->phone_number );
+}
+
+//
+// build_indexes
+// Builds the search indexes over the sorted list.
+// Each contact is numbered by its position in the list.
+// Must be called again whenever the list changes.
+//
+void build_indexes( Contact *first, ContactIndexes *indexes, double filter_rate ) {
+  unordered_map<string, uint32_t> name_ids;
+  vector<uint64_t> deletes;
+  size_t rank = 0;
+
+  // Every column starts with the offset of its first value
+  indexes->columns = QueryColumns();
+  indexes->columns.first_names.offsets.push_back( 0 );
+  indexes->columns.last_names.offsets.push_back( 0 );
+  indexes->columns.phone_numbers.offsets.push_back( 0 );
+
+  for( Contact *contact = first; contact != NULL; contact = get_next( contact ) ) {
+    contact->rank = rank++;
+
+    // Keep each field in a column of its own for queries
+    add_to_column( &indexes->columns.first_names, contact->first_name );
+    add_to_column( &indexes->columns.last_names, contact->last_name );
+    add_to_column( &indexes->columns.phone_numbers, contact->phone_number );
+    indexes->columns.contacts.push_back( contact );
+
+    // Index the lowercased first name and last name of the contact
+    string names[] = { lower_case(contact->first_name), lower_case(contact->last_name) };
+
+    for( int i = 0; i < 2; i++ ) {
+      // Contacts that share a name share its deletions
+      unordered_map<string, uint32_t>::iterator id = name_ids.find( names[i] );
+
+      if( id == name_ids.end() ) {
+        id = name_ids.insert( make_pair( names[i], (uint32_t) indexes->names.size() ) ).first;
+        indexes->names.push_back( IndexedName() );
+        indexes->names.back().name = names[i];
+
+        deletes.clear();
+        name_deletes( names[i], FUZZY_MAX_DISTANCE, &deletes );
+        for( size_t j = 0; j < deletes.size(); j++ ) {
+          indexes->name_deletes.push_back( NameDelete{ deletes[j], id->second } );
+        }
+      }
+
+      vector<uint32_t> &ranks = indexes->names[id->second].ranks;
+      if( ranks.empty() || ranks.back() != contact->rank ) ranks.push_back( contact->rank );
+    }
+  }
+
+  // Sort the deletions so a search can find them by hash
+  sort( indexes->name_deletes.begin(), indexes->name_deletes.end() );
+
+  // Searches cached before the list changed may no longer be right
+  clear_search_cache( &indexes->search_cache );
+
+  build_checkpoints( first, indexes );
+
+  // Every distinct name goes into the filter used to turn away exact searches
+  build_name_filter( &indexes->name_filter, indexes->names.size(), filter_rate );
+  for( size_t i = 0; i < indexes->names.size(); i++ ) {
+    add_to_filter( &indexes->name_filter, indexes->names[i].name );
+  }
+}
+
+//
+// build_name_filter
+// Sizes an empty Bloom filter for a number of names so that
+// a name that was never added passes it at about false_rate.
+// Every name sets its bits within one 64 byte block so a check
+// touches a single cache line.
+//
+void build_name_filter( NameFilter *filter, size_t name_count, double false_rate ) {
+  double bits_per_name = -log( false_rate ) / ( log( 2.0 ) * log( 2.0 ) );
+  size_t bit_count = max( (size_t) FILTER_BLOCK_BITS, (size_t) ( bits_per_name * max( (size_t) 1, name_count ) ) );
+
+  filter->block_count = ( bit_count + FILTER_BLOCK_BITS - 1 ) / FILTER_BLOCK_BITS;
+  filter->hash_count  = max( 1, (int) round( bits_per_name * log( 2.0 ) ) );
+  filter->bits.assign( filter->block_count * FILTER_BLOCK_BITS / 64, 0 );
+}
+
+//
+// add_to_filter
+// Sets the bits of a name in the filter.
+//
+void add_to_filter( NameFilter *filter, const string &name ) {
+  uint64_t name_hash = hash<string>()( name );
+  uint64_t *block = &filter->bits[( name_hash % filter->block_count ) * FILTER_BLOCK_BITS / 64];
+  uint64_t step = mix_hash( name_hash ) | 1;
+
+  for( int i = 0; i < filter->hash_count; i++ ) {
+    uint64_t bit = ( name_hash + i * step ) >> 32 & ( FILTER_BLOCK_BITS - 1 );
+    block[bit / 64] |= (uint64_t) 1 << ( bit % 64 );
+  }
+}
+
+//
+// filter_may_contain
+// Returns false when a name was certainly never added to the filter.
+//
+bool filter_may_contain( NameFilter *filter, string_view name ) {
+  if( filter->block_count == 0 ) return true;
+
+  // Hashes the same as the string added to the filter
+  uint64_t name_hash = hash<string_view>()( name );
+  const uint64_t *block = &filter->bits[( name_hash % filter->block_count ) * FILTER_BLOCK_BITS / 64];
+  uint64_t step = mix_hash( name_hash ) | 1;
+
+  for( int i = 0; i < filter->hash_count; i++ ) {
+    uint64_t bit = ( name_hash + i * step ) >> 32 & ( FILTER_BLOCK_BITS - 1 );
+    if( !( block[bit / 64] & ( (uint64_t) 1 << ( bit % 64 ) ) ) ) return false;
+  }
+
+  return true;
+}
+
+//
+// mix_hash
+// Scrambles the bits of a hash to derive a second, independent hash.
+//
+uint64_t mix_hash( uint64_t value ) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+
+  return value;
+}
+
+//
+// build_checkpoints
+// Records every CHECKPOINT_INTERVAL-th contact of the list
+// so any position can be reached without walking from the start.
+//
+void build_checkpoints( Contact *first, ContactIndexes *indexes ) {
+  size_t position = 0;
+
+  indexes->checkpoints.clear();
+
+  for( Contact *contact = first; contact != NULL; contact = get_next( contact ) ) {
+    if( position % CHECKPOINT_INTERVAL == 0 ) indexes->checkpoints.push_back( contact );
+    position++;
+  }
+
+  indexes->contact_count = position;
+}
+
+//
+// contact_at
+// Returns the contact at a position in the list, counting from zero,
+// by walking from the checkpoint before it. Returns NULL past the end.
+//
+Contact *contact_at( ContactIndexes *indexes, size_t position ) {
+  if( position >= indexes->contact_count ) return NULL;
+
+  Contact *contact = indexes->checkpoints[position / CHECKPOINT_INTERVAL];
+
+  for( size_t i = 0; i < position % CHECKPOINT_INTERVAL; i++ ) {
+    contact = get_next( contact );
+  }
+
+  return contact;
+}
+
+//
+// display_index_stats
+// Displays the size and memory use of the search indexes.
+//
+void display_index_stats( ContactIndexes *indexes ) {
+  size_t name_bytes = indexes->names.capacity() * sizeof(IndexedName)
+    + indexes->name_deletes.capacity() * sizeof(NameDelete);
+
+  for( size_t i = 0; i < indexes->names.size(); i++ ) {
+    const IndexedName &name = indexes->names[i];
+    name_bytes += name.ranks.capacity() * sizeof(uint32_t);
+
+    name_bytes += string_heap_bytes( name.name );
+  }
+
+  cout << "Fuzzy name index: " << indexes->names.size() << " names, "
+    << indexes->name_deletes.size() << " deletions, " << name_bytes / 1024 << " KB" << endl
+    << "Name filter: " << indexes->name_filter.block_count << " blocks, " << indexes->name_filter.hash_count
+    << " hashes, " << indexes->name_filter.bits.capacity() * sizeof(uint64_t) / 1024 << " KB" << endl
+    << "Query columns: " << ( indexes->columns.first_names.chars.capacity() + indexes->columns.last_names.chars.capacity()
+      + indexes->columns.phone_numbers.chars.capacity() + ( indexes->columns.first_names.offsets.capacity()
+      + indexes->columns.last_names.offsets.capacity() + indexes->columns.phone_numbers.offsets.capacity()
+      + indexes->columns.contacts.capacity() ) * sizeof(size_t) ) / 1024 << " KB" << endl << endl;
+}
+
+//
+// string_heap_bytes
+// Returns the bytes a string allocated for its characters.
+// Short strings are stored inside the string itself and allocate none.
+//
+size_t string_heap_bytes( const string &value ) {
+  const char *object = (const char *) &value;
+
+  if( value.data() >= object && value.data() < object + sizeof(string) ) return 0;
+
+  return value.capacity() + 1;
+}
+
+//
+// run_server
+// Answers requests from many clients over a Unix socket or a
+// localhost TCP port. The list is loaded and sorted once and
+// shared by the worker threads. Each connection keeps its own
+// current contact for the traverse requests. Requests are one
+// line each and every answer ends with a line holding a period:
+//    SEARCH <name>     Contacts whose first or last name contains name,
+//                      or is name when it starts with =
+//    QUERY <query>     Contacts matching a query, see run_query
+//    FUZZY <name>      Contacts whose first or last name is close to name
+//    LIST              All contacts
+//    FIRST, LAST       Move to the first or last contact and show it
+//    NEXT, PREV        Move to the next or previous contact and show it
+//    JUMP <position>   Move to the contact at a position, counting from one
+//    PAGE <page>       Contacts on a page of SERVER_PAGE_SIZE, counting from one
+//    STATS             Hit rate, memory, and latency of the search cache
+//    QUIT              Close the connection
+//
+void run_server( const char *address, Contact *first, Contact *last, ContactIndexes *indexes, int workers ) {
+  Server server;
+  server.first    = first;
+  server.last     = last;
+  server.indexes  = indexes;
+
+  unordered_map<int, Connection*> connections;
+  epoll_event events[SERVER_MAX_EVENTS];
+
+  // Writing to a client that hung up should not end the server
+  signal( SIGPIPE, SIG_IGN );
+
+  int epoll_fd  = epoll_create1( 0 );
+  server.listen_fd   = open_listener( address );
+  server.spare_fd    = open( "/dev/null", O_RDONLY | O_CLOEXEC );
+  server.listening   = true;
+  server.finished_fd = eventfd( 0, EFD_NONBLOCK );
+
+  if( epoll_fd < 0 || server.finished_fd < 0 ) {
+    cout << "Could not start the server." << endl;
+    exit(1);
+  }
+
+  watch_fd( epoll_fd, EPOLL_CTL_ADD, server.listen_fd, EPOLLIN );
+  watch_fd( epoll_fd, EPOLL_CTL_ADD, server.finished_fd, EPOLLIN );
+
+  // Start the threads that answer requests
+  vector<thread> threads;
+  for( int i = 0; i < workers; i++ ) {
+    threads.push_back( thread( server_worker, &server ) );
+  }
+
+  cout << "Serving contacts on " << address << " with " << workers << " workers." << endl;
+
+  while( true ) {
+    int count = epoll_wait( epoll_fd, events, SERVER_MAX_EVENTS, -1 );
+
+    for( int i = 0; i < count; i++ ) {
+      int fd = events[i].data.fd;
+
+      if( fd == server.listen_fd ) { // Accept every waiting client
+        accept_clients( &server, epoll_fd, &connections );
+
+      } else if( fd == server.finished_fd ) { // Send answers from the workers
+        uint64_t ignored;
+        vector<ServerJob> finished;
+
+        if( read( server.finished_fd, &ignored, sizeof(ignored) ) < 0 ) { }
+
+        {
+          lock_guard<mutex> guard( server.lock );
+          finished.swap( server.finished );
+        }
+
+        for( size_t j = 0; j < finished.size(); j++ ) {
+          Connection *connection = finished[j].connection;
+          connection->busy = false;
+          connection->output += finished[j].response;
+          if( finished[j].quit ) connection->closing = true;
+
+          update_connection( &server, connection, epoll_fd, &connections );
+        }
+
+      } else { // Read requests or send waiting answers
+        // The connection may have closed earlier in this batch of events
+        unordered_map<int, Connection*>::iterator found = connections.find( fd );
+        if( found == connections.end() ) continue;
+
+        Connection *connection = found->second;
+
+        if( !connection->hung_up && ( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) ) {
+          read_requests( connection );
+        }
+
+        update_connection( &server, connection, epoll_fd, &connections );
+      }
+    }
+  }
+}
+
+//
+// server_worker
+// Answers queued requests until the server stops.
+// Answers are handed back to the event loop through finished_fd.
+//
+void server_worker( Server *server ) {
+  while( true ) {
+    ServerJob job;
+
+    {
+      unique_lock<mutex> guard( server->lock );
+      server->jobs_ready.wait( guard, [server]() { return !server->jobs.empty(); } );
+      job = server->jobs.front();
+      server->jobs.pop_front();
+    }
+
+    job.response = answer_request( server, job.connection, job.request, &job.quit );
+
+    {
+      lock_guard<mutex> guard( server->lock );
+      server->finished.push_back( job );
+    }
+
+    uint64_t one = 1;
+    if( write( server->finished_fd, &one, sizeof(one) ) < 0 ) { }
+  }
+}
+
+//
+// answer_request
+// Returns the answer to one request from a client.
+// Sets quit when the client asked to close the connection.
+//
+string answer_request( Server *server, Connection *connection, const string &request, bool *quit ) {
+  ostringstream out;
+  vector<Contact*> contacts;
+  bool move_cursor = false;
+  *quit = false;
+
+  // Split the request into a command and its argument
+  size_t space = request.find( ' ' );
+  string command  = request.substr( 0, space );
+  string argument = ( space == string::npos ) ? "" : request.substr( space + 1 );
+
+  if( command == "SEARCH" ) {
+    find_matches( server->first, server->indexes, lower_case(argument), &contacts, true );
+
+  } else if( command == "QUERY" ) {
+    string error;
+    contacts = run_query( server->indexes, argument, &error );
+    if( !error.empty() ) return error + "\n.\n";
+
+  } else if( command == "FUZZY" ) {
+    vector<FuzzyMatch> matches = fuzzy_search( server->indexes, argument );
+    for( size_t i = 0; i < matches.size(); i++ ) contacts.push_back( matches[i].contact );
+
+  } else if( command == "LIST" ) {
+    for( Contact *contact = server->first; contact != NULL; contact = get_next( contact ) ) {
+      contacts.push_back( contact );
+    }
+
+  } else if( command == "FIRST" ) {
+    move_cursor = true;
+    if( server->first != NULL ) connection->cursor = server->first;
+
+  } else if( command == "LAST" ) {
+    move_cursor = true;
+    if( server->last != NULL ) connection->cursor = server->last;
+
+  } else if( command == "NEXT" || command == "PREV" ) {
+    move_cursor = true;
+    Contact *contact = ( command == "NEXT" ) ? get_next( connection->cursor ) : get_prev( connection->cursor );
+    if( contact != NULL ) connection->cursor = contact;
+    else contacts.push_back( NULL );
+
+  } else if( command == "JUMP" ) {
+    move_cursor = true;
+    size_t position = strtoul( argument.c_str(), NULL, 10 );
+    Contact *contact = ( position > 0 ) ? contact_at( server->indexes, position - 1 ) : NULL;
+    if( contact != NULL ) connection->cursor = contact;
+    else contacts.push_back( NULL );
+
+  } else if( command == "PAGE" ) {
+    size_t page = strtoul( argument.c_str(), NULL, 10 );
+    size_t page_count = ( server->indexes->contact_count + SERVER_PAGE_SIZE - 1 ) / SERVER_PAGE_SIZE;
+    Contact *contact = ( page > 0 && page <= page_count ) ? contact_at( server->indexes, ( page - 1 ) * SERVER_PAGE_SIZE ) : NULL;
+
+    for( size_t i = 0; i < SERVER_PAGE_SIZE && contact != NULL; i++ ) {
+      contacts.push_back( contact );
+      contact = get_next( contact );
+    }
+
+  } else if( command == "STATS" ) {
+    display_cache_stats( out, &server->indexes->search_cache );
+    out << "." << endl;
+    return out.str();
+
+  } else if( command == "QUIT" ) {
+    *quit = true;
+    return ".\n";
+
+  } else { // If an invalid request was sent
+    return "Please send a valid request.\n.\n";
+  }
+
+  // Traverse requests show the current contact
+  if( move_cursor && contacts.empty() && connection->cursor != NULL ) {
+    contacts.push_back( connection->cursor );
+  }
+
+  if( contacts.empty() || contacts[0] == NULL ) out << "No contact was found." << endl;
+
+  for( size_t i = 0; i < contacts.size() && contacts[i] != NULL; i++ ) {
+    display_row( out, contacts[i]->first_name, contacts[i]->last_name, contacts[i]->phone_number );
+  }
+
+  out << "." << endl;
+
+  return out.str();
+}
+
+//
+// accept_clients
+// Accepts every waiting client. The listener stays readable while
+// clients wait, so when the server is out of file descriptors the
+// spare one is given up to accept and hang up on a client. Without
+// a spare, the server stops listening until a connection closes.
+//
+void accept_clients( Server *server, int epoll_fd, unordered_map<int, Connection*> *connections ) {
+  while( true ) {
+    int client_fd = accept4( server->listen_fd, NULL, NULL, SOCK_NONBLOCK );
+
+    if( client_fd >= 0 ) {
+      Connection *connection = new Connection;
+      connection->fd      = client_fd;
+      connection->cursor  = NULL;
+      connection->busy    = false;
+      connection->closing = false;
+      connection->hung_up = false;
+      connection->watched = true;
+
+      (*connections)[client_fd] = connection;
+      watch_fd( epoll_fd, EPOLL_CTL_ADD, client_fd, EPOLLIN );
+      continue;
+    }
+
+    if( errno == EINTR || errno == ECONNABORTED ) continue;
+    if( errno == EAGAIN || errno == EWOULDBLOCK ) return;
+
+    if( errno != EMFILE && errno != ENFILE ) {
+      cout << "Could not accept a client: " << strerror( errno ) << endl;
+      return;
+    }
+
+    if( server->spare_fd >= 0 ) {
+      close( server->spare_fd );
+      client_fd = accept( server->listen_fd, NULL, NULL );
+      int error = errno;
+
+      if( client_fd >= 0 ) close( client_fd );
+      server->spare_fd = open( "/dev/null", O_RDONLY | O_CLOEXEC );
+
+      if( client_fd >= 0 ) {
+        cout << "Out of file descriptors, turned away a client." << endl;
+        continue;
+      }
+      if( error == EAGAIN || error == EWOULDBLOCK ) return;
+    }
+
+    cout << "Out of file descriptors, waiting for a connection to close." << endl;
+    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, server->listen_fd, NULL );
+    server->listening = false;
+    return;
+  }
+}
+
+//
+// read_requests
+// Reads what the client has sent so far, up to SERVER_MAX_REQUEST
+// bytes of unanswered input. When the client hung up, the requests
+// already received are kept and an unfinished last line is dropped.
+// A request line longer than SERVER_MAX_REQUEST closes the connection.
+//
+void read_requests( Connection *connection ) {
+  char buffer[SERVER_READ_SIZE];
+
+  while( connection->input.size() < SERVER_MAX_REQUEST ) {
+    ssize_t count = read( connection->fd, buffer, sizeof(buffer) );
+
+    if( count > 0 ) {
+      connection->input.append( buffer, count );
+    } else {
+      // Nothing more to read until the client sends again
+      if( count < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) break;
+
+      connection->hung_up = true;
+      connection->input.erase( connection->input.rfind( '\n' ) + 1 );
+      break;
+    }
+  }
+
+  if( min( connection->input.find( '\n' ), connection->input.size() ) >= SERVER_MAX_REQUEST ) {
+    connection->output += "Request is too long.\n.\n";
+    connection->closing = true;
+    connection->input.clear();
+  }
+}
+
+//
+// update_connection
+// Sends waiting answers, queues the next request, and closes the
+// connection once it is closing, or the client hung up and every
+// request was answered, and no worker is answering for it.
+//
+void update_connection( Server *server, Connection *connection, int epoll_fd, unordered_map<int, Connection*> *connections ) {
+  // Send as much of the waiting answers as the socket takes
+  while( !connection->output.empty() ) {
+    ssize_t count = send( connection->fd, connection->output.data(), connection->output.size(), MSG_NOSIGNAL );
+
+    if( count > 0 ) {
+      connection->output.erase( 0, count );
+    } else if( count < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+      break;
+    } else { // The client can no longer be written to
+      connection->output.clear();
+      connection->closing = true;
+    }
+  }
+
+  // Only one request of a connection is answered at a time so answers stay in order
+  size_t end_of_line = connection->input.find( '\n' );
+
+  if( !connection->busy && !connection->closing && end_of_line != string::npos ) {
+    ServerJob job;
+    job.connection = connection;
+    job.request    = connection->input.substr( 0, end_of_line );
+    job.quit       = false;
+    connection->input.erase( 0, end_of_line + 1 );
+
+    if( !job.request.empty() && job.request[job.request.size() - 1] == '\r' ) {
+      job.request.erase( job.request.size() - 1 );
+    }
+
+    connection->busy = true;
+
+    {
+      lock_guard<mutex> guard( server->lock );
+      server->jobs.push_back( job );
+    }
+    server->jobs_ready.notify_one();
+  }
+
+  bool answered = connection->closing || ( connection->hung_up && connection->input.find( '\n' ) == string::npos );
+
+  // Close the connection once its last answer is sent
+  if( answered && !connection->busy && connection->output.empty() ) {
+    if( connection->watched ) epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL );
+    close( connection->fd );
+    connections->erase( connection->fd );
+    delete connection;
+
+    // Take the freed file descriptor back as the spare and accept clients again
+    if( !server->listening ) {
+      if( server->spare_fd < 0 ) server->spare_fd = open( "/dev/null", O_RDONLY | O_CLOEXEC );
+      watch_fd( epoll_fd, EPOLL_CTL_ADD, server->listen_fd, EPOLLIN );
+      server->listening = true;
+    }
+    return;
+  }
+
+  // Read until the client hangs up or sends too much, and
+  // wait for room to send when answers are left over
+  uint32_t events = 0;
+  if( !connection->hung_up && !connection->closing && connection->input.size() < SERVER_MAX_REQUEST ) events |= EPOLLIN;
+  if( !connection->output.empty() ) events |= EPOLLOUT;
+
+  // A client that hung up would keep reporting it, so stop
+  // watching it while a worker answers its last requests
+  if( events == 0 ) {
+    if( connection->watched ) epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL );
+    connection->watched = false;
+  } else {
+    watch_fd( epoll_fd, connection->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection->fd, events );
+    connection->watched = true;
+  }
+}
+
+//
+// watch_fd
+// Adds or changes the events the event loop waits for on a file descriptor.
+//
+void watch_fd( int epoll_fd, int operation, int fd, uint32_t events ) {
+  epoll_event event;
+  event.events  = events;
+  event.data.fd = fd;
+
+  epoll_ctl( epoll_fd, operation, fd, &event );
+}
+
+//
+// server_address
+// Fills in the socket address for a Unix socket path, or for
+// a localhost TCP port when the address is only digits.
+//
+socklen_t server_address( const char *address, sockaddr_storage *storage ) {
+  memset( storage, 0, sizeof(*storage) );
+
+  if( address[0] != '\0' && strspn( address, "0123456789" ) == strlen( address ) ) {
+    sockaddr_in *tcp = (sockaddr_in *) storage;
+    tcp->sin_family      = AF_INET;
+    tcp->sin_port        = htons( atoi( address ) );
+    tcp->sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    return sizeof(sockaddr_in);
+  }
+
+  sockaddr_un *local = (sockaddr_un *) storage;
+  local->sun_family = AF_UNIX;
+  strncpy( local->sun_path, address, sizeof(local->sun_path) - 1 );
+  return sizeof(sockaddr_un);
+}
+
+//
+// open_listener
+// Opens a socket that accepts clients on the given address.
+// Exit the program when the address cannot be used.
+//
+int open_listener( const char *address ) {
+  sockaddr_storage storage;
+  socklen_t length = server_address( address, &storage );
+  int one = 1;
+
+  // Remove a socket file left behind by an earlier server
+  if( storage.ss_family == AF_UNIX ) unlink( address );
+
+  int listen_fd = socket( storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+  setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+
+  if( listen_fd < 0 || ::bind( listen_fd, (sockaddr *) &storage, length ) < 0
+    || listen( listen_fd, SERVER_BACKLOG ) < 0 ) {
+    cout << "Could not listen on " << address << "." << endl;
+    exit(1);
+  }
+
+  return listen_fd;
+}
+
+//
+// connect_to_server
+// Opens a blocking connection to a server.
+// Exit the program when the server cannot be reached.
+//
+int connect_to_server( const char *address ) {
+  sockaddr_storage storage;
+  socklen_t length = server_address( address, &storage );
+
+  int fd = socket( storage.ss_family, SOCK_STREAM, 0 );
+
+  if( fd < 0 || connect( fd, (sockaddr *) &storage, length ) < 0 ) {
+    cout << "Could not connect to " << address << "." << endl;
+    exit(1);
+  }
+
+  return fd;
+}
+
+//
+// run_load_test
+// Opens many connections to a running server and sends searches
+// for last names from the contact file as fast as answers arrive.
+// Displays the requests per second, the latency percentiles,
+// and the figures of the server's search cache.
+//
+void run_load_test( const char *address, Contact *first, Options *options ) {
+  vector<string> names;
+  vector<double> latencies;
+  mutex latencies_lock;
+  vector<thread> clients;
+
+  for( Contact *contact = first; contact != NULL; contact = get_next( contact ) ) {
+    if( !contact->last_name.empty() ) names.push_back( contact->last_name );
+  }
+
+  if( names.empty() ) {
+    cout << "There are no contacts." << endl;
+    return;
+  }
+
+  // A Zipf workload searches each distinct last name with a probability
+  // falling off with its rank, so a few names make up most searches
+  vector<double> zipf_weights;
+
+  if( options->zipf > 0 ) {
+    sort( names.begin(), names.end() );
+    names.erase( unique( names.begin(), names.end() ), names.end() );
+    shuffle( names.begin(), names.end(), mt19937( 0 ) );
+
+    for( size_t i = 0; i < names.size(); i++ ) zipf_weights.push_back( 1.0 / pow( i + 1.0, options->zipf ) );
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  for( int c = 0; c < options->clients; c++ ) {
+    clients.push_back( thread( [&, c]() {
+      int fd = connect_to_server( address );
+      mt19937 random( c );
+      discrete_distribution<size_t> zipf( zipf_weights.begin(), zipf_weights.end() );
+      vector<double> client_latencies;
+      string request, response;
+      char buffer[SERVER_READ_SIZE];
+
+      for( int r = 0; r < options->requests; r++ ) {
+        size_t name = zipf_weights.empty() ? random() % names.size() : zipf( random );
+        request = "SEARCH " + names[name] + "\n";
+        chrono::steady_clock::time_point sent = chrono::steady_clock::now();
+
+        if( send( fd, request.data(), request.size(), MSG_NOSIGNAL ) < 0 ) break;
+
+        // Read until the line that ends the answer
+        response.clear();
+        while( !( response == ".\n" || ( response.size() > 2
+          && response.compare( response.size() - 3, 3, "\n.\n" ) == 0 ) ) ) {
+          ssize_t count = read( fd, buffer, sizeof(buffer) );
+          if( count <= 0 ) break;
+          response.append( buffer, count );
+        }
+
+        client_latencies.push_back( chrono::duration<double, micro>( chrono::steady_clock::now() - sent ).count() );
+      }
+
+      close( fd );
+
+      lock_guard<mutex> guard( latencies_lock );
+      latencies.insert( latencies.end(), client_latencies.begin(), client_latencies.end() );
+    } ) );
+  }
+
+  for( size_t c = 0; c < clients.size(); c++ ) clients[c].join();
+
+  double elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+  sort( latencies.begin(), latencies.end() );
+
+  if( latencies.empty() ) {
+    cout << "No requests were answered." << endl;
+    return;
+  }
+
+  cout << latencies.size() << " requests from " << options->clients << " clients in " << elapsed << " seconds" << endl
+    << "Requests per second: " << latencies.size() / elapsed << endl
+    << "Latency p50: " << latencies[latencies.size() / 2] << " us, p99: " << latencies[latencies.size() * 99 / 100]
+    << " us, p99.9: " << latencies[latencies.size() * 999 / 1000] << " us, max: " << latencies.back() << " us" << endl;
+
+  // Display the server's search cache figures
+  int fd = connect_to_server( address );
+  string response;
+  char buffer[SERVER_READ_SIZE];
+  ssize_t count;
+
+  const char request[] = "STATS\nQUIT\n";
+
+  if( send( fd, request, sizeof(request) - 1, MSG_NOSIGNAL ) == (ssize_t) sizeof(request) - 1 ) {
+    while( ( count = read( fd, buffer, sizeof(buffer) ) ) > 0 ) response.append( buffer, count );
+  }
+  close( fd );
+
+  // Leave out the lines that end each answer
+  istringstream lines( response );
+  string line;
+  while( getline( lines, line ) ) {
+    if( line != "." ) cout << line << endl;
+  }
+}
+
+//
+// build_compact_directory
+// Packs the sorted list into blocks of COMPACT_BLOCK_SIZE contacts.
+// Within a block each name only stores what differs from the same
+// name of the contact before it, and phone numbers are packed two
+// characters to a byte when they only hold digits and punctuation.
+//
+void build_compact_directory( Contact *first, CompactDirectory *directory ) {
+  string prev_first_name, prev_last_name;
+  size_t position = 0;
+
+  directory->data.clear();
+  directory->block_offsets.clear();
+
+  for( Contact *contact = first; contact != NULL; contact = get_next( contact ) ) {
+    // Start a new block with nothing to share
+    if( position % COMPACT_BLOCK_SIZE == 0 ) {
+      directory->block_offsets.push_back( directory->data.size() );
+      prev_first_name.clear();
+      prev_last_name.clear();
+    }
+
+    // Sorting by last name first makes neighbouring last names share the most
+    write_front_coded( &directory->data, prev_last_name, contact->last_name );
+    write_front_coded( &directory->data, prev_first_name, contact->first_name );
+    write_phone( &directory->data, contact->phone_number );
+
+    prev_last_name  = contact->last_name;
+    prev_first_name = contact->first_name;
+    position++;
+  }
+
+  directory->contact_count = position;
+  directory->data.shrink_to_fit();
+  directory->block_offsets.shrink_to_fit();
+}
+
+//
+// write_varint
+// Appends a number using seven bits per byte. The high bit
+// of a byte is set when more bytes of the number follow.
+//
+void write_varint( vector<uint8_t> *data, size_t value ) {
+  while( value >= 0x80 ) {
+    data->push_back( ( value & 0x7f ) | 0x80 );
+    value >>= 7;
+  }
+
+  data->push_back( value );
+}
+
+//
+// read_varint
+// Reads a number written by write_varint and moves past it.
+//
+size_t read_varint( const uint8_t **data ) {
+  size_t value = 0;
+  int shift = 0;
+
+  while( **data & 0x80 ) {
+    value |= (size_t) ( **data & 0x7f ) << shift;
+    shift += 7;
+    (*data)++;
+  }
+
+  value |= (size_t) **data << shift;
+  (*data)++;
+
+  return value;
+}
+
+//
+// write_front_coded
+// Appends a name as the length it shares with the previous
+// name followed by the rest of the name.
+//
+void write_front_coded( vector<uint8_t> *data, const string &prev_name, const string &name ) {
+  size_t shared = 0;
+
+  while( shared < prev_name.size() && shared < name.size() && prev_name[shared] == name[shared] ) {
+    shared++;
+  }
+
+  write_varint( data, shared );
+  write_varint( data, name.size() - shared );
+  data->insert( data->end(), name.begin() + shared, name.end() );
+}
+
+//
+// read_front_coded
+// Rebuilds a name from the previous name and moves past it.
+//
+void read_front_coded( const uint8_t **data, string *name ) {
+  size_t shared = read_varint( data );
+  size_t rest   = read_varint( data );
+
+  name->resize( shared );
+  name->append( (const char *) *data, rest );
+  *data += rest;
+}
+
+//
+// write_phone
+// Appends a phone number. Numbers made only of PHONE_SYMBOLS are
+// packed two symbols to a byte; anything else is stored as is.
+// The lowest bit of the length tells which was used.
+//
+void write_phone( vector<uint8_t> *data, const string &phone_number ) {
+  bool packed = true;
+
+  for( size_t i = 0; i < phone_number.size() && packed; i++ ) {
+    if( phone_number[i] == '\0' || strchr( PHONE_SYMBOLS, phone_number[i] ) == NULL ) packed = false;
+  }
+
+  write_varint( data, phone_number.size() << 1 | ( packed ? 1 : 0 ) );
+
+  if( !packed ) {
+    data->insert( data->end(), phone_number.begin(), phone_number.end() );
+    return;
+  }
+
+  for( size_t i = 0; i < phone_number.size(); i += 2 ) {
+    uint8_t high = strchr( PHONE_SYMBOLS, phone_number[i] ) - PHONE_SYMBOLS;
+    uint8_t low  = ( i + 1 < phone_number.size() ) ? strchr( PHONE_SYMBOLS, phone_number[i + 1] ) - PHONE_SYMBOLS : 0;
+    data->push_back( high << 4 | low );
+  }
+}
+
+//
+// read_phone
+// Rebuilds a phone number written by write_phone and moves past it.
+//
+void read_phone( const uint8_t **data, string *phone_number ) {
+  size_t header = read_varint( data );
+  size_t length = header >> 1;
+
+  if( !( header & 1 ) ) {
+    phone_number->assign( (const char *) *data, length );
+    *data += length;
+    return;
+  }
+
+  phone_number->resize( length );
+
+  for( size_t i = 0; i < length; i++ ) {
+    uint8_t symbols = (*data)[i / 2];
+    (*phone_number)[i] = PHONE_SYMBOLS[( i % 2 == 0 ) ? symbols >> 4 : symbols & 0x0f];
+  }
+
+  *data += ( length + 1 ) / 2;
+}
+
+//
+// decode_block
+// Unpacks every contact of a block into records.
+// The records are reused so their strings keep their memory.
+//
+void decode_block( CompactDirectory *directory, size_t block, vector<ContactRecord> *records ) {
+  size_t start = block * COMPACT_BLOCK_SIZE;
+  size_t count = min( COMPACT_BLOCK_SIZE, directory->contact_count - start );
+  const uint8_t *data = &directory->data[directory->block_offsets[block]];
+
+  records->resize( count );
+
+  for( size_t i = 0; i < count; i++ ) {
+    ContactRecord &record = (*records)[i];
+
+    // Each name starts from the same name of the contact before it
+    if( i > 0 ) {
+      record.last_name  = (*records)[i - 1].last_name;
+      record.first_name = (*records)[i - 1].first_name;
+    }
+
+    read_front_coded( &data, &record.last_name );
+    read_front_coded( &data, &record.first_name );
+    read_phone( &data, &record.phone_number );
+  }
+}
+
+//
+// compact_menu
+// Present the main menu for a compact directory. It offers only
+// the original search, listing, and traversal by previous and next.
+// Exact (=) searches, fuzzy search, paging, queries, and jumping to
+// a position need the search indexes over the full list, which are
+// not built in compact mode.
+//
+void compact_menu( CompactDirectory *directory ) {
+  bool exit = false;
+  char choice;
+
+  // Display a menu
+  do {
+
+    // Give user choices
+    cout << "Main Menu" << endl
+    << "------------------" << endl
+    << "1.) Search" << endl
+    << "2.) List all" << endl
+    << "3.) Show first contact in list" << endl
+    << "4.) Show last contact in list" << endl
+    << "5.) Exit" << endl
+    << "Choice: ";
+    cin >> choice;
+
+    // Associate choice with an action
+    switch(choice) {
+      case '1': // Search contacts
+        cout << endl;
+        compact_search_contacts( directory );
+        cout << endl;
+        break;
+
+      case '2': // List all contacts
+        cout << endl;
+        compact_list_all_contacts( directory );
+        cout << endl;
+        break;
 
-        if( next_contact == NULL ) {
-          cout << "No contact was found." << endl;
-        } else { // Contact was found
-          // Set contact to point to next contact for possible reiteration
-          current_contact = next_contact;
-          // Print contact first name, last name, and phone number
-          display_contact( current_contact );
-        }
+      case '3': // Show first contact
+        cout << endl;
+        compact_traverse_menu( directory, 0 );
+        cout << endl;
+        break;
+
+      case '4': // Show last contact
+        cout << endl;
+        compact_traverse_menu( directory, directory->contact_count - 1 );
+        cout << endl;
+        break;
+
+      case '5': // Exit program
+        exit = true;
+        break;
+
+      default: // Error occured
+        cout << "Please enter a valid option." << endl;
+        break;
+    }
+
+  } while(!exit);
+}
+
+//
+// compact_search_contacts
+// Allow the user to search a compact directory by first
+// or last name and display all matches.
+//
+void compact_search_contacts( CompactDirectory *directory ) {
+  string user_input;
+
+  // Prompt user for first or last name
+  cout << "Enter first or last name: ";
+  cin >> user_input;
+
+  cout << endl; // Extra endline to maintain a neat layout
+
+  // Lowercase user input
+  vector<ContactRecord> matches = compact_find_contacts( directory, lower_case(user_input) );
+
+  display_header( cout );
+
+  // Print contact first name, last name, and phone number
+  for( size_t i = 0; i < matches.size(); i++ ) {
+    display_row( cout, matches[i].first_name, matches[i].last_name, matches[i].phone_number );
+  }
+
+  // Inform user if no contact was found
+  if( matches.empty() ) cout << "No contact was found." << endl;
+
+}
+
+//
+// compact_find_contacts
+// Returns the same contacts as find_contacts by unpacking
+// the compact directory one block at a time.
+//
+vector<ContactRecord> compact_find_contacts( CompactDirectory *directory, const string &name ) {
+  vector<ContactRecord> matches, records;
+
+  for( size_t block = 0; block < directory->block_offsets.size(); block++ ) {
+    decode_block( directory, block, &records );
+
+    for( size_t i = 0; i < records.size(); i++ ) {
+      // Compare first and last contact name without case against user input
+      if( contains_folded( records[i].first_name, name ) || contains_folded( records[i].last_name, name ) ) {
+        matches.push_back( records[i] );
+      }
+    }
+  }
+
+  return matches;
+}
+
+//
+// compact_list_all_contacts
+// Displays all the contacts in a compact directory.
+//
+void compact_list_all_contacts( CompactDirectory *directory ) {
+  vector<ContactRecord> records;
+
+  // Return to menu when no records
+  if( directory->contact_count == 0 ) {
+    cout << "There are no contacts.";
+    return;
+  }
+
+  display_header( cout );
+
+  for( size_t block = 0; block < directory->block_offsets.size(); block++ ) {
+    decode_block( directory, block, &records );
+
+    for( size_t i = 0; i < records.size(); i++ ) {
+      display_row( cout, records[i].first_name, records[i].last_name, records[i].phone_number );
+    }
+  }
+}
+
+//
+// compact_traverse_menu
+// Presents the traverse menu for a compact directory, starting
+// at a position in the list. Only the block holding the current
+// contact is unpacked.
+//
+void compact_traverse_menu( CompactDirectory *directory, size_t position ) {
+  vector<ContactRecord> records;
+  size_t block = SIZE_MAX;
+  bool exit = false, moved = true;
+
+  // Return to menu when no records
+  if( directory->contact_count == 0 ) {
+    cout << "There are no contacts.";
+    return;
+  }
+
+  do {
+    // Print the current contact, unpacking its block when it changed
+    if( moved ) {
+      if( position / COMPACT_BLOCK_SIZE != block ) {
+        block = position / COMPACT_BLOCK_SIZE;
+        decode_block( directory, block, &records );
+      }
+
+      ContactRecord &record = records[position % COMPACT_BLOCK_SIZE];
+      display_header( cout );
+      display_row( cout, record.first_name, record.last_name, record.phone_number );
+      moved = false;
+    }
+
+    cout << endl; // Extra endline to maintain a neat layout
+
+    cout << "1. Previous" << endl;
+    cout << "2. Next" << endl;
+    cout << "3. Return to main menu" << endl;
+    cout << "Choice: ";
+    char choice;
+    cin >> choice;
+
+    cout << endl; // Extra endline to maintain a neat layout
+
+    // Associate choice with an action
+    switch(choice) {
+      case '1': // Get previous contact (if possible)
+        if( position == 0 ) cout << "No contact was found." << endl;
+        else { position--; moved = true; }
+        break;
+
+      case '2': // Get next contact (if possible)
+        if( position + 1 == directory->contact_count ) cout << "No contact was found." << endl;
+        else { position++; moved = true; }
         break;
 
       case '3': //Exit traverse menu
@@ -380,24 +3275,82 @@ void traverse_menu( Contact *current_contact ) {
 }
 
 //
-// display_contact
-// Displays a given contact from the list.
+// display_compact_stats
+// Displays the bytes used per contact by the compact
+// directory and by the list it was built from.
 //
-void display_contact( Contact *contact ) {
-  cout << "First Name                    Last Name                     Phone Number" << endl;
-  cout << "------------------------------------------------------------------------" << endl;
+void display_compact_stats( Contact *first, CompactDirectory *directory ) {
+  size_t list_bytes = 0;
+  size_t compact_bytes = directory->data.capacity() + directory->block_offsets.capacity() * sizeof(size_t);
 
-  // Print first name, last name, and phone number
-  cout << setw(30) << left << contact->first_name;
-  cout << setw(30) << left << contact->last_name;
-  cout << setw(30) << left << contact->phone_number << endl;
+  // Count each contact and every string too long to be stored inside itself
+  for( Contact *contact = first; contact != NULL; contact = get_next( contact ) ) {
+    const string *fields[] = { &contact->first_name, &contact->last_name, &contact->phone_number };
+    list_bytes += sizeof(Contact);
+
+    for( int i = 0; i < 3; i++ ) list_bytes += string_heap_bytes( *fields[i] );
+  }
+
+  size_t count = max( (size_t) 1, directory->contact_count );
+  cout << "Compact directory: " << directory->contact_count << " contacts, "
+    << (double) compact_bytes / count << " bytes per contact (list: "
+    << (double) list_bytes / count << " bytes per contact)" << endl << endl;
+}
+
+//
+// delete_contacts
+// Frees every contact in the list.
+//
+void delete_contacts( Contact **first, Contact **last ) {
+  Contact *contact = *first;
+
+  while( contact != NULL ) {
+    Contact *next = contact->next;
+    delete contact;
+    contact = next;
+  }
+
+  *first = *last = NULL;
+}
+
+//
+// display_header
+// Displays the column headings of a contact listing.
+//
+void display_header( ostream &out ) {
+  out << "First Name                    Last Name                     Phone Number" << endl;
+  out << "------------------------------------------------------------------------" << endl;
+}
+
+//
+// display_row
+// Displays the first name, last name, and phone number
+// of a contact as one row of a contact listing.
+//
+void display_row( ostream &out, const string &first_name, const string &last_name, const string &phone_number ) {
+  display_field( out, first_name );
+  display_field( out, last_name );
+  display_field( out, phone_number );
+  out.put( '\n' );
+}
+
+//
+// display_field
+// Displays a value left aligned in a column of a contact listing.
+// The padding is written from a fixed row of spaces.
+//
+void display_field( ostream &out, const string &value ) {
+  static const char spaces[DISPLAY_FIELD_WIDTH + 1] = "                              ";
+
+  out.write( value.data(), value.size() );
+  if( value.size() < DISPLAY_FIELD_WIDTH ) out.write( spaces, DISPLAY_FIELD_WIDTH - value.size() );
 }
 
 //
 // display_first_contact
 // Displays the first contact in the list.
 //
-void display_first_contact( Contact *first ) {
+void display_first_contact( Contact *first, ContactIndexes *indexes ) {
   // Return to menu when no records
   if( first == NULL ) {
     cout << "There are no contacts.";
@@ -405,7 +3358,7 @@ void display_first_contact( Contact *first ) {
   }
 
   // Display traverse menu
-  traverse_menu( first );
+  traverse_menu( first, indexes );
 
 }
 
@@ -413,21 +3366,15 @@ void display_first_contact( Contact *first ) {
 // display_last_contact
 // Displays the last contact in the list.
 //
-void display_last_contact( Contact *last ) {
+void display_last_contact( Contact *last, ContactIndexes *indexes ) {
   // Return to menu when no records
   if( last == NULL ) {
     cout << "There are no contacts.";
     return;
   }
 
-  // Find last contact
-  Contact *contact = last;
-  while(contact->next != NULL) {
-    contact = contact->next;
-  }
-
   // Display traverse menu
-  traverse_menu( last );
+  traverse_menu( last, indexes );
 
 }
 
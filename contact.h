@@ -9,30 +9,410 @@
 
 #pragma once
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <sys/socket.h>
 using namespace std;
 
 // The name of the file that the contact data resides
 const char FILE_NAME[] = "contacts.dat";
 
+// Default memory cap (in kilobytes) for a sorted run when streaming the list
+const size_t DEFAULT_STREAM_MEMORY_KB = 64 * 1024;
+// Smallest memory cap (in kilobytes) accepted, so runs hold more than a few contacts
+const size_t MIN_STREAM_MEMORY_KB = 64;
+// Most sorted runs merged at once, which bounds the open temporary files
+const size_t MAX_MERGE_RUNS = 64;
+
+// Bytes of the contact file read ahead at a time while loading
+const size_t LOAD_BLOCK_SIZE = 1024 * 1024;
+
+// Most edits between two lowercased names of possible duplicates
+const int DUPLICATE_NAME_DISTANCE = 2;
+// Most edits between the phone digits of possible duplicates
+const int DUPLICATE_PHONE_DISTANCE = 1;
+// Number of last name characters shared by contacts in a duplicate block
+const size_t DUPLICATE_BLOCK_PREFIX = 3;
+// Contacts further apart than this within a block are not compared
+const size_t DUPLICATE_WINDOW = 64;
+
+// Most edits between a fuzzy search and a matching name
+const int FUZZY_MAX_DISTANCE = 2;
+// Fuzzy searches of at most this many characters allow a single edit
+const size_t FUZZY_SHORT_NAME = 5;
+
+// Clients waiting to be accepted by the server
+const int SERVER_BACKLOG = 128;
+// Most events handled by one pass of the server event loop
+const int SERVER_MAX_EVENTS = 64;
+// Bytes read from a socket at a time
+const size_t SERVER_READ_SIZE = 4096;
+// Longest request line, and most unanswered input kept for a connection
+const size_t SERVER_MAX_REQUEST = 65536;
+// Default number of connections and searches per connection of a load test
+const int DEFAULT_LOAD_TEST_CLIENTS = 8;
+const int DEFAULT_LOAD_TEST_REQUESTS = 1000;
+
+// Number of searches remembered by the search cache
+const size_t SEARCH_CACHE_SLOTS = 1024;
+// Matches of one search the cache holds room for when used by the menus
+const size_t MENU_SEARCH_CONTACTS = 256;
+// Most matches held by the search cache at once, 16 MB of contacts
+const size_t SEARCH_CACHE_TOTAL_CONTACTS = 1 << 21;
+
+// Longest search the menus hold without allocating
+const size_t MAX_SEARCH_LENGTH = 64;
+// Number of measured runs of the allocation check script
+const int ALLOCATION_CHECK_RUNS = 10;
+// Width of each column of a contact listing
+const size_t DISPLAY_FIELD_WIDTH = 30;
+
+// Every this many contacts a checkpoint is recorded for jumping into the list
+const size_t CHECKPOINT_INTERVAL = 64;
+// Default number of contacts on a page of the paged listing
+const size_t DEFAULT_PAGE_SIZE = 20;
+// Number of contacts on a page answered by the server
+const size_t SERVER_PAGE_SIZE = 20;
+
+// Number of contacts packed together in a block of the compact directory
+const size_t COMPACT_BLOCK_SIZE = 16;
+// Phone number characters that can be packed two to a byte
+const char PHONE_SYMBOLS[] = "0123456789-()+. ";
+
+// Most parentheses and NOT terms a query may nest
+const int QUERY_MAX_DEPTH = 64;
+
+// Default rate at which a name not in the list passes the name filter
+const double DEFAULT_FILTER_RATE = 0.01;
+// Bits in one block of the name filter, which is one cache line
+const size_t FILTER_BLOCK_BITS = 512;
+
 struct Contact {
   string  first_name;
   string  last_name;
   string  phone_number;
   Contact *prev, *next;
+  size_t  rank;   // Position in the sorted list, set by build_indexes
+};
+
+// A lowercased first or last name and the contacts that have it
+struct IndexedName {
+  string            name;
+  vector<uint32_t>  ranks;   // Of the contacts, in list order
+};
+
+// The hash of a string made by deleting characters from an indexed name
+struct NameDelete {
+  uint64_t  hash;
+  uint32_t  name;
+
+  bool operator<( const NameDelete &other ) const {
+    return hash < other.hash || ( hash == other.hash && name < other.name );
+  }
+};
+
+// A search remembered by the search cache
+struct CachedSearch {
+  bool              used;
+  bool              referenced;   // Found again since the clock hand passed
+  uint64_t          hash;
+  string            name;
+  vector<Contact*>  contacts;
+
+  CachedSearch() : used( false ), referenced( false ), hash( 0 ) {}
+};
+
+// Results of recent searches, replaced in clock order.
+// Shared by server workers, so every use holds the lock.
+struct SearchCache {
+  mutex                 lock;
+  vector<CachedSearch>  slots;
+  size_t                hand;
+  size_t                stored;   // Matches held by every slot together
+  size_t                hits, misses;
+  double                hit_seconds, miss_seconds;
+
+  SearchCache() : hand( 0 ), stored( 0 ), hits( 0 ), misses( 0 ), hit_seconds( 0 ), miss_seconds( 0 ) {}
+};
+
+// Input buffers reused by the menus so that searching,
+// traversing, and displaying do not allocate after startup
+struct MenuBuffers {
+  string            user_input;
+  string            name;       // Lowercased user input
+  vector<Contact*>  matches;
+};
+
+// An output buffer that discards everything written to it
+struct NullBuffer : public streambuf {
+  int overflow( int c ) { return c; }
+};
+
+// A Bloom filter of lowercased names split into 64 byte blocks
+struct NameFilter {
+  vector<uint64_t>  bits;
+  size_t            block_count;
+  int               hash_count;
+
+  NameFilter() : block_count( 0 ), hash_count( 0 ) {}
+};
+
+struct ContactIndexes;
+
+// Lowercased values of one field for every contact in list order,
+// stored end to end. Value i runs from offsets[i] to offsets[i + 1].
+struct StringColumn {
+  vector<char>    chars;
+  vector<size_t>  offsets;
+};
+
+// Each field of the list in a column of its own for queries
+struct QueryColumns {
+  StringColumn      first_names;
+  StringColumn      last_names;     // Sorted, as the list is
+  StringColumn      phone_numbers;
+  vector<Contact*>  contacts;
 };
 
-void traverse_menu( Contact *current_contact );
-void main_menu( Contact **first, Contact **last );
+// One bit per contact in list order
+typedef vector<uint64_t> Bitmap;
+
+// A query being read by run_query
+struct QueryParser {
+  ContactIndexes  *indexes;
+  vector<string>  tokens;
+  size_t          position;
+  int             depth;      // Parentheses and NOT terms being read
+  string          error;
+};
+
+// Indexes built over the sorted list to speed up searches
+struct ContactIndexes {
+  vector<IndexedName> names;
+  vector<NameDelete>  name_deletes;   // Sorted by hash
+  SearchCache         search_cache;
+  vector<Contact*>    checkpoints;    // Every CHECKPOINT_INTERVAL-th contact
+  size_t              contact_count;
+  NameFilter          name_filter;    // Every distinct name in names
+  QueryColumns        columns;
+
+  ContactIndexes() : contact_count( 0 ) {}
+};
+
+// A contact found by fuzzy search and its distance from the search
+struct FuzzyMatch {
+  int     distance;
+  Contact *contact;
+  size_t  rank;       // Of the contact, kept here to rank without visiting it
+};
+
+// A contact read from file that is not linked into the list
+struct ContactRecord {
+  string  first_name;
+  string  last_name;
+  string  phone_number;
+  string  sort_key;
+};
+
+// A client connected to the server
+struct Connection {
+  int     fd;
+  string  input;     // Received but not yet answered
+  string  output;    // Answered but not yet sent
+  Contact *cursor;   // Current contact of the traverse requests
+  bool    busy;      // A worker is answering a request
+  bool    closing;   // Close once the last answer is sent
+  bool    hung_up;   // The client will send nothing more
+  bool    watched;   // The event loop is waiting for events on fd
+};
+
+// A request handed to a server worker and its answer
+struct ServerJob {
+  Connection  *connection;
+  string      request;
+  string      response;
+  bool        quit;
+};
+
+// State shared by the server event loop and its workers
+struct Server {
+  Contact             *first, *last;
+  ContactIndexes      *indexes;
+  mutex               lock;
+  condition_variable  jobs_ready;
+  deque<ServerJob>    jobs;
+  vector<ServerJob>   finished;
+  int                 finished_fd;   // Signals the event loop about finished jobs
+  int                 listen_fd;
+  int                 spare_fd;      // Given up to turn away clients when out of file descriptors
+  bool                listening;     // Whether the event loop watches for new clients
+};
+
+// The sorted list packed into blocks that are unpacked on demand
+struct CompactDirectory {
+  vector<uint8_t> data;
+  vector<size_t>  block_offsets;   // Where each block starts in data
+  size_t          contact_count;
+
+  CompactDirectory() : contact_count( 0 ) {}
+};
+
+// A block of the contact file read ahead by load_data
+struct LoadBuffer {
+  vector<char>  data;
+  size_t        size;
+  bool          ready;   // Filled and not yet used
+  bool          last;    // Holds the end of the file
+
+  LoadBuffer() : size( 0 ), ready( false ), last( false ) {}
+};
+
+// Two buffers filled in turn by a reader thread while
+// load_data builds contacts from the other one
+struct BlockReader {
+  ifstream            *input;
+  LoadBuffer          buffers[2];
+  mutex               lock;
+  condition_variable  changed;
+  int                 current;    // Buffer being used by load_data
+  size_t              position;   // Next character in the current buffer
+  bool                waited;     // The current buffer is known to be ready
+
+  BlockReader() : input( NULL ), current( 0 ), position( 0 ), waited( false ) {}
+};
+
+// Command line options given to the program
+struct Options {
+  bool    stream;
+  size_t  stream_memory;
+  bool    duplicates;
+  bool    merge_duplicates;
+  bool    index_stats;
+  char    *server;
+  int     workers;
+  char    *load_test;
+  int     clients;
+  int     requests;
+  double  zipf;
+  size_t  page_size;
+  bool    compact;
+  double  filter_rate;
+  char    *query;
+  bool    check_allocations;
+};
+
+void traverse_menu( Contact *current_contact, ContactIndexes *indexes );
+void page_menu( ContactIndexes *indexes, size_t page_size );
+void display_page( ContactIndexes *indexes, size_t page, size_t page_size );
+size_t read_number();
+void main_menu( Contact **first, Contact **last, ContactIndexes *indexes, MenuBuffers *buffers, size_t page_size );
+void reserve_menu_buffers( MenuBuffers *buffers, ContactIndexes *indexes );
+#ifdef CHECK_ALLOCATIONS
+void check_allocations( Contact **first, Contact **last, ContactIndexes *indexes, MenuBuffers *buffers, size_t page_size );
+size_t allocations();
+#endif
+void parse_options( int argc, char *argv[], Options *options );
+void display_usage( const char *program );
 void load_data( Contact **first, Contact **last );
+void open_data_file( ifstream &input );
+void read_blocks( BlockReader *reader );
+void read_word( BlockReader *reader, string *word, bool *at_end );
+bool fill_buffer( BlockReader *reader );
 string lower_case( string value );
 
 void sort_contacts( Contact **first, Contact **last );
 Contact *get_next(Contact *current_contact);
 Contact *get_prev(Contact *current_contact);
 Contact *new_contact( Contact *prev_node, string first_name, string last_name, string phone_number );
+void remove_contact( Contact **first, Contact **last, Contact *contact );
+
+void find_duplicates( Contact **first, Contact **last, bool merge );
+size_t find_group( vector<size_t> &groups, size_t i );
+void join_groups( vector<size_t> &groups, size_t a, size_t b );
+int edit_distance( const string &a, const string &b, int max_distance );
+string phone_digits( const string &phone_number );
 
-void search_contacts( Contact *first );
+void search_contacts( Contact *first, ContactIndexes *indexes, MenuBuffers *buffers );
+void find_contacts( Contact *first, string_view name, vector<Contact*> *matches );
+bool contains_folded( string_view text, string_view name );
+void find_matches( Contact *first, ContactIndexes *indexes, string_view name, vector<Contact*> *matches, bool allocate );
+void find_exact_contacts( ContactIndexes *indexes, string_view name, vector<Contact*> *matches );
+void cached_find_contacts( Contact *first, ContactIndexes *indexes, string_view name, vector<Contact*> *matches, bool allocate );
+void clear_search_cache( SearchCache *cache );
+CachedSearch *find_cached_search( SearchCache *cache, uint64_t name_hash, string_view name );
+CachedSearch *next_cache_victim( SearchCache *cache );
+void display_cache_stats( ostream &out, SearchCache *cache );
+void fuzzy_search_contacts( ContactIndexes *indexes );
+vector<FuzzyMatch> fuzzy_search( ContactIndexes *indexes, const string &user_input );
+vector<FuzzyMatch> fuzzy_find( ContactIndexes *indexes, const string &name, int max_distance );
+bool matched_closer( const vector<FuzzyMatch> &matches, const vector<size_t> &run_starts, size_t rank );
+void query_contacts( ContactIndexes *indexes );
+vector<Contact*> run_query( ContactIndexes *indexes, const string &query, string *error );
+Bitmap parse_or( QueryParser *parser );
+Bitmap parse_and( QueryParser *parser );
+Bitmap parse_term( QueryParser *parser );
+void match_column( ContactIndexes *indexes, StringColumn *column, const string &value, bool prefix, Bitmap *result );
+void match_last_names( ContactIndexes *indexes, const string &value, bool prefix, Bitmap *result );
+string_view column_value( StringColumn *column, size_t position );
+void add_to_column( StringColumn *column, const string &value );
+void build_indexes( Contact *first, ContactIndexes *indexes, double filter_rate );
+void build_name_filter( NameFilter *filter, size_t name_count, double false_rate );
+void add_to_filter( NameFilter *filter, const string &name );
+bool filter_may_contain( NameFilter *filter, string_view name );
+uint64_t mix_hash( uint64_t value );
+void name_deletes( const string &name, int max_deletes, vector<uint64_t> *deletes );
+void display_index_stats( ContactIndexes *indexes );
+size_t string_heap_bytes( const string &value );
+void build_checkpoints( Contact *first, ContactIndexes *indexes );
+Contact *contact_at( ContactIndexes *indexes, size_t position );
+
+void run_server( const char *address, Contact *first, Contact *last, ContactIndexes *indexes, int workers );
+void server_worker( Server *server );
+string answer_request( Server *server, Connection *connection, const string &request, bool *quit );
+void accept_clients( Server *server, int epoll_fd, unordered_map<int, Connection*> *connections );
+void read_requests( Connection *connection );
+void update_connection( Server *server, Connection *connection, int epoll_fd, unordered_map<int, Connection*> *connections );
+void watch_fd( int epoll_fd, int operation, int fd, uint32_t events );
+socklen_t server_address( const char *address, sockaddr_storage *storage );
+int open_listener( const char *address );
+int connect_to_server( const char *address );
+void run_load_test( const char *address, Contact *first, Options *options );
 void list_all_contacts( Contact *first );
-void display_first_contact( Contact *first );
-void display_last_contact( Contact *last );
-void display_contact( Contact *contact );
\ No newline at end of file
+void display_first_contact( Contact *first, ContactIndexes *indexes );
+void display_last_contact( Contact *last, ContactIndexes *indexes );
+void display_contact( Contact *contact );
+void build_compact_directory( Contact *first, CompactDirectory *directory );
+void write_varint( vector<uint8_t> *data, size_t value );
+size_t read_varint( const uint8_t **data );
+void write_front_coded( vector<uint8_t> *data, const string &prev_name, const string &name );
+void read_front_coded( const uint8_t **data, string *name );
+void write_phone( vector<uint8_t> *data, const string &phone_number );
+void read_phone( const uint8_t **data, string *phone_number );
+void decode_block( CompactDirectory *directory, size_t block, vector<ContactRecord> *records );
+void compact_menu( CompactDirectory *directory );
+void compact_search_contacts( CompactDirectory *directory );
+vector<ContactRecord> compact_find_contacts( CompactDirectory *directory, const string &name );
+void compact_list_all_contacts( CompactDirectory *directory );
+void compact_traverse_menu( CompactDirectory *directory, size_t position );
+void display_compact_stats( Contact *first, CompactDirectory *directory );
+void delete_contacts( Contact **first, Contact **last );
+void display_header( ostream &out );
+void display_row( ostream &out, const string &first_name, const string &last_name, const string &phone_number );
+void display_field( ostream &out, const string &value );
+
+void stream_sorted_contacts( size_t memory_cap );
+string sort_key( const string &first_name, const string &last_name );
+FILE *new_run();
+FILE *merge_into_run( vector<FILE*> &runs );
+FILE *write_run( vector<ContactRecord> &records );
+bool read_run_record( FILE *run, ContactRecord *record );
+void write_run_record( FILE *run, const ContactRecord &record );
+void merge_runs( vector<FILE*> &runs, FILE *output );